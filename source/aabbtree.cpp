@@ -0,0 +1,307 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#include "aabbtree.h"
+
+AABBTree::AABBTree()
+    : root(-1), freeList(-1)
+{
+}
+
+void AABBTree::clear()
+{
+    nodes.clear();
+    root = -1;
+    freeList = -1;
+}
+
+int AABBTree::allocate()
+{
+    if (freeList == -1)
+    {
+        nodes.push_back({});
+        freeList = (int)nodes.size() - 1;
+        nodes[freeList].parent = -1;
+    }
+
+    int node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node].body = 0;
+    nodes[node].parent = -1;
+    nodes[node].child1 = -1;
+    nodes[node].child2 = -1;
+    nodes[node].height = 0;
+    return node;
+}
+
+void AABBTree::release(int node)
+{
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+int AABBTree::insert(Rigid* body, const AABB& box)
+{
+    int leaf = allocate();
+    nodes[leaf].box = { box.min - float2{ AABB_FAT_MARGIN, AABB_FAT_MARGIN }, box.max + float2{ AABB_FAT_MARGIN, AABB_FAT_MARGIN } };
+    nodes[leaf].body = body;
+    insertLeaf(leaf);
+    return leaf;
+}
+
+void AABBTree::remove(int leaf)
+{
+    removeLeaf(leaf);
+    release(leaf);
+}
+
+bool AABBTree::move(int leaf, const AABB& box)
+{
+    if (contains(nodes[leaf].box, box))
+        return false;
+
+    removeLeaf(leaf);
+    nodes[leaf].box = { box.min - float2{ AABB_FAT_MARGIN, AABB_FAT_MARGIN }, box.max + float2{ AABB_FAT_MARGIN, AABB_FAT_MARGIN } };
+    insertLeaf(leaf);
+    return true;
+}
+
+void AABBTree::insertLeaf(int leaf)
+{
+    if (root == -1)
+    {
+        root = leaf;
+        nodes[root].parent = -1;
+        return;
+    }
+
+    // Find the best sibling for this leaf, using the increase in perimeter as the cost
+    AABB leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].leaf())
+    {
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+
+        float area = perimeter(nodes[index].box);
+        float combinedArea = perimeter(combine(nodes[index].box, leafBox));
+
+        // Cost of creating a new parent for this node and the new leaf
+        float cost = 2.0f * combinedArea;
+
+        // Minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        // Cost of descending into each child
+        float cost1 = perimeter(combine(leafBox, nodes[child1].box)) + inheritanceCost;
+        if (!nodes[child1].leaf())
+            cost1 -= perimeter(nodes[child1].box);
+
+        float cost2 = perimeter(combine(leafBox, nodes[child2].box)) + inheritanceCost;
+        if (!nodes[child2].leaf())
+            cost2 -= perimeter(nodes[child2].box);
+
+        if (cost < cost1 && cost < cost2)
+            break;
+
+        index = cost1 < cost2 ? child1 : child2;
+    }
+
+    // Create a new parent joining the sibling and the leaf
+    int sibling = index;
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocate();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent != -1)
+    {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    }
+    else
+        root = newParent;
+
+    // Walk back up the tree fixing heights and boxes
+    for (index = nodes[leaf].parent; index != -1; index = nodes[index].parent)
+    {
+        index = balance(index);
+
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+        nodes[index].height = 1 + (nodes[child1].height > nodes[child2].height ? nodes[child1].height : nodes[child2].height);
+        nodes[index].box = combine(nodes[child1].box, nodes[child2].box);
+    }
+}
+
+void AABBTree::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = -1;
+        return;
+    }
+
+    // Replace the parent with the sibling
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != -1)
+    {
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        release(parent);
+
+        // Walk back up the tree fixing heights and boxes
+        for (int index = grandParent; index != -1; index = nodes[index].parent)
+        {
+            index = balance(index);
+
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            nodes[index].height = 1 + (nodes[child1].height > nodes[child2].height ? nodes[child1].height : nodes[child2].height);
+            nodes[index].box = combine(nodes[child1].box, nodes[child2].box);
+        }
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = -1;
+        release(parent);
+    }
+}
+
+// Performs a left or right rotation if node A is imbalanced, and returns the new root of the subtree
+int AABBTree::balance(int iA)
+{
+    Node* A = &nodes[iA];
+    if (A->leaf() || A->height < 2)
+        return iA;
+
+    int iB = A->child1;
+    int iC = A->child2;
+    Node* B = &nodes[iB];
+    Node* C = &nodes[iC];
+
+    int difference = C->height - B->height;
+
+    // Rotate C up
+    if (difference > 1)
+    {
+        int iF = C->child1;
+        int iG = C->child2;
+        Node* F = &nodes[iF];
+        Node* G = &nodes[iG];
+
+        // Swap A and C
+        C->child1 = iA;
+        C->parent = A->parent;
+        A->parent = iC;
+
+        // A's old parent should point to C
+        if (C->parent != -1)
+        {
+            if (nodes[C->parent].child1 == iA)
+                nodes[C->parent].child1 = iC;
+            else
+                nodes[C->parent].child2 = iC;
+        }
+        else
+            root = iC;
+
+        // Rotate
+        if (F->height > G->height)
+        {
+            C->child2 = iF;
+            A->child2 = iG;
+            G->parent = iA;
+            A->box = combine(B->box, G->box);
+            C->box = combine(A->box, F->box);
+            A->height = 1 + (B->height > G->height ? B->height : G->height);
+            C->height = 1 + (A->height > F->height ? A->height : F->height);
+        }
+        else
+        {
+            C->child2 = iG;
+            A->child2 = iF;
+            F->parent = iA;
+            A->box = combine(B->box, F->box);
+            C->box = combine(A->box, G->box);
+            A->height = 1 + (B->height > F->height ? B->height : F->height);
+            C->height = 1 + (A->height > G->height ? A->height : G->height);
+        }
+
+        return iC;
+    }
+
+    // Rotate B up
+    if (difference < -1)
+    {
+        int iD = B->child1;
+        int iE = B->child2;
+        Node* D = &nodes[iD];
+        Node* E = &nodes[iE];
+
+        // Swap A and B
+        B->child1 = iA;
+        B->parent = A->parent;
+        A->parent = iB;
+
+        // A's old parent should point to B
+        if (B->parent != -1)
+        {
+            if (nodes[B->parent].child1 == iA)
+                nodes[B->parent].child1 = iB;
+            else
+                nodes[B->parent].child2 = iB;
+        }
+        else
+            root = iB;
+
+        // Rotate
+        if (D->height > E->height)
+        {
+            B->child2 = iD;
+            A->child1 = iE;
+            E->parent = iA;
+            A->box = combine(C->box, E->box);
+            B->box = combine(A->box, D->box);
+            A->height = 1 + (C->height > E->height ? C->height : E->height);
+            B->height = 1 + (A->height > D->height ? A->height : D->height);
+        }
+        else
+        {
+            B->child2 = iE;
+            A->child1 = iD;
+            D->parent = iA;
+            A->box = combine(C->box, D->box);
+            B->box = combine(A->box, E->box);
+            A->height = 1 + (C->height > D->height ? C->height : D->height);
+            B->height = 1 + (A->height > E->height ? A->height : E->height);
+        }
+
+        return iB;
+    }
+
+    return iA;
+}
@@ -0,0 +1,216 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "maths.h"
+
+#define AABB_FAT_MARGIN 0.1f          // Amount leaf boxes in the tree are enlarged by, so small movements don't require a reinsert
+
+struct Rigid;
+
+// Axis aligned bounding box
+struct AABB
+{
+    float2 min;
+    float2 max;
+};
+
+inline bool overlaps(const AABB& a, const AABB& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y;
+}
+
+inline bool contains(const AABB& a, const AABB& b)
+{
+    return a.min.x <= b.min.x && a.min.y <= b.min.y && a.max.x >= b.max.x && a.max.y >= b.max.y;
+}
+
+inline bool contains(const AABB& a, float2 p)
+{
+    return p.x >= a.min.x && p.x <= a.max.x && p.y >= a.min.y && p.y <= a.max.y;
+}
+
+inline AABB combine(const AABB& a, const AABB& b)
+{
+    return { float2{ min(a.min.x, b.min.x), min(a.min.y, b.min.y) }, float2{ max(a.max.x, b.max.x), max(a.max.y, b.max.y) } };
+}
+
+inline float perimeter(const AABB& a)
+{
+    return 2.0f * ((a.max.x - a.min.x) + (a.max.y - a.min.y));
+}
+
+// Stack of node indices for the tree traversals. Starts in a fixed buffer, and moves to the heap if a degenerate tree outgrows it.
+struct NodeStack
+{
+    int fixed[256];
+    std::vector<int> heap;
+    int* data;
+    int capacity;
+    int count;
+
+    NodeStack() : data(fixed), capacity(256), count(0) {}
+
+    bool empty() const { return count == 0; }
+    int pop() { return data[--count]; }
+
+    void push(int node)
+    {
+        if (count == capacity)
+        {
+            if (data == fixed)
+                heap.assign(fixed, fixed + count);
+            capacity *= 2;
+            heap.resize(capacity);
+            data = heap.data();
+        }
+        data[count++] = node;
+    }
+};
+
+// Dynamic bounding volume tree of rigid bodies, adapted from the dynamic tree in box2d.
+// Leaves store enlarged ("fat") boxes, so bodies only need to be reinserted when they move out of them,
+// and the tree is kept balanced with rotations as leaves are inserted and removed.
+struct AABBTree
+{
+    struct Node
+    {
+        AABB box;
+        Rigid* body;    // Only set for leaves
+        int parent;     // Also used as the next pointer of the free list
+        int child1;
+        int child2;
+        int height;     // Leaves are 0, free nodes -1
+
+        bool leaf() const { return child1 == -1; }
+    };
+
+    std::vector<Node> nodes;
+    int root;
+    int freeList;
+
+    AABBTree();
+
+    int insert(Rigid* body, const AABB& box);
+    void remove(int leaf);
+
+    // Reinserts the leaf if the tight box has moved outside its fat box. Returns true if the leaf was reinserted.
+    bool move(int leaf, const AABB& box);
+
+    void clear();
+
+    // Calls callback(Rigid*) for every leaf whose fat box overlaps the given box, until the callback returns false
+    template <typename Callback>
+    void query(const AABB& box, Callback callback) const;
+
+    // Calls callback(Rigid*) for every leaf whose fat box contains the given point, until the callback returns false
+    template <typename Callback>
+    void query(float2 point, Callback callback) const;
+
+    // Casts the segment from p1 to p1 + (p2 - p1) * maxFraction through the tree. For every leaf box the segment touches,
+    // calls callback(Rigid*, maxFraction), which returns the new max fraction to clip the segment to (0 terminates).
+    template <typename Callback>
+    void raycast(float2 p1, float2 p2, float maxFraction, Callback callback) const;
+
+private:
+    int allocate();
+    void release(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int node);
+};
+
+template <typename Callback>
+void AABBTree::query(const AABB& box, Callback callback) const
+{
+    if (root == -1)
+        return;
+
+    NodeStack stack;
+    stack.push(root);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.pop()];
+        if (!overlaps(node.box, box))
+            continue;
+
+        if (node.leaf())
+        {
+            if (!callback(node.body))
+                return;
+        }
+        else
+        {
+            stack.push(node.child1);
+            stack.push(node.child2);
+        }
+    }
+}
+
+template <typename Callback>
+void AABBTree::query(float2 point, Callback callback) const
+{
+    query(AABB{ point, point }, callback);
+}
+
+template <typename Callback>
+void AABBTree::raycast(float2 p1, float2 p2, float maxFraction, Callback callback) const
+{
+    if (root == -1)
+        return;
+
+    float2 d = p2 - p1;
+    float2 inv = { 1.0f / d.x, 1.0f / d.y };
+
+    NodeStack stack;
+    stack.push(root);
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.pop()];
+
+        // Slab test of the segment against the node box
+        float tmin = 0.0f;
+        float tmax = maxFraction;
+        bool hit = true;
+        for (int i = 0; i < 2 && hit; i++)
+        {
+            if (d[i] == 0.0f)
+            {
+                hit = p1[i] >= node.box.min[i] && p1[i] <= node.box.max[i];
+                continue;
+            }
+
+            float t1 = (node.box.min[i] - p1[i]) * inv[i];
+            float t2 = (node.box.max[i] - p1[i]) * inv[i];
+            tmin = max(tmin, min(t1, t2));
+            tmax = min(tmax, max(t1, t2));
+            hit = tmin <= tmax;
+        }
+
+        if (!hit)
+            continue;
+
+        if (node.leaf())
+        {
+            maxFraction = callback(node.body, maxFraction);
+            if (maxFraction <= 0.0f)
+                return;
+        }
+        else
+        {
+            stack.push(node.child1);
+            stack.push(node.child2);
+        }
+    }
+}
@@ -0,0 +1,378 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+// Headless benchmark runner. Steps every scene in scenes.h without a window and reports
+// per-step timings and world statistics as CSV (default) or JSON, so runs can be diffed across commits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "solver.h"
+#include "scenes.h"
+
+struct BenchConfig
+{
+    int steps;
+    int warmup;
+    int threads;
+    bool tree;
+    int reorder;
+    bool sleep;
+    bool adaptive;
+    bool chebyshev;
+    int iterations;
+    float budget;
+};
+
+struct BenchResult
+{
+    const char* name;
+    int steps;
+    int bodies;
+    int forces;
+    int contacts;
+    double mean;
+    double median;
+    double p99;
+    double stepsPerSecond;
+    uint32_t checksum;
+
+    // Per-step averages of the solver instrumentation
+    double phases[PHASE_COUNT];
+    double pairsTested;
+    double manifoldsCreated;
+    double manifoldsDestroyed;
+    double primalRows;
+    double dualRows;
+    double solves;
+    double awakeBodies;
+    double islands;
+    double iterations;
+    double residual;
+    double error;
+    double cacheMisses;     // Per step hardware cache misses, or -1 if the counter is unavailable
+};
+
+// Counts hardware cache misses of this thread with perf events. Only available on Linux, and when perf events are permitted.
+struct CacheCounter
+{
+    int fd;
+
+    CacheCounter() : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Returns the misses since start()
+    long long stop()
+    {
+        long long count = 0;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+};
+
+static const char* phaseNames[PHASE_COUNT] = {
+    "reorder",
+    "broadphase",
+    "initialize",
+    "warmstart",
+    "coloring",
+    "primal",
+    "dual",
+    "velocity"
+};
+
+static void usage(const char* exe)
+{
+    printf("Usage: %s [options]\n", exe);
+    printf("  --steps N       Number of timed steps per scene (default 600)\n");
+    printf("  --warmup N      Number of untimed steps before timing (default 0)\n");
+    printf("  --scene S       Only run the scene with the given index or name (may be repeated)\n");
+    printf("  --threads N     Number of solver threads (default 1)\n");
+    printf("  --tree          Use the AABB tree broadphase instead of sort and sweep\n");
+    printf("  --reorder N     Sort the bodies along a Morton curve every N steps (default 0, disabled)\n");
+    printf("  --no-sleep      Never put resting bodies to sleep\n");
+    printf("  --adaptive      Stop iterating once the residual is below the solver tolerance\n");
+    printf("  --chebyshev     Accelerate the solver iterations with Chebyshev semi-iteration\n");
+    printf("  --iterations N  Number of solver iterations (default 10)\n");
+    printf("  --budget MS     Time budget of each step in milliseconds, which may stop the iterations early (default 0, disabled)\n");
+    printf("  --json          Output JSON instead of CSV\n");
+    printf("  --list          List the available scenes and exit\n");
+}
+
+static int findScene(const char* s)
+{
+    char* end;
+    long index = strtol(s, &end, 10);
+    if (*end == 0)
+        return index >= 0 && index < sceneCount ? (int)index : -1;
+
+    for (int i = 0; i < sceneCount; i++)
+        if (strcmp(sceneNames[i], s) == 0)
+            return i;
+    return -1;
+}
+
+// Hash of the final body state, so that changes in simulation results show up when diffing runs
+static uint32_t checksum(Solver* solver)
+{
+    uint32_t hash = 2166136261u;
+    for (int b = 0; b < solver->bodies.size(); b++)
+    {
+        const unsigned char* bytes = (const unsigned char*)&solver->bodies.position[b];
+        for (int i = 0; i < (int)sizeof(float3); i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static BenchResult run(int scene, const BenchConfig& config)
+{
+    Solver* solver = new Solver();
+    solver->threads = config.threads;
+    solver->broadphase.useTree = config.tree;
+    solver->reorderInterval = config.reorder;
+    solver->enableSleep = config.sleep;
+    solver->adaptiveIterations = config.adaptive;
+    solver->chebyshev = config.chebyshev;
+    solver->iterations = config.iterations;
+    solver->timeBudget = config.budget;
+    scenes[scene](solver);
+
+    for (int i = 0; i < config.warmup; i++)
+        solver->step();
+
+    int steps = config.steps;
+    BenchResult result = {};
+    result.name = sceneNames[scene];
+    result.steps = steps;
+
+    CacheCounter counter;
+    std::vector<double> times(steps);
+    for (int i = 0; i < steps; i++)
+    {
+        counter.start();
+        auto start = std::chrono::steady_clock::now();
+        solver->step();
+        auto end = std::chrono::steady_clock::now();
+        result.cacheMisses += (double)counter.stop();
+        times[i] = std::chrono::duration<double, std::milli>(end - start).count();
+
+        const StepStats& stats = solver->stats;
+        for (int p = 0; p < PHASE_COUNT; p++)
+            result.phases[p] += stats.time[p];
+        result.pairsTested += stats.pairsTested;
+        result.manifoldsCreated += stats.manifoldsCreated;
+        result.manifoldsDestroyed += stats.manifoldsDestroyed;
+        result.primalRows += stats.primalRows;
+        result.dualRows += stats.dualRows;
+        result.solves += stats.solves;
+        result.awakeBodies += stats.awakeBodies;
+        result.islands += stats.islands;
+        result.iterations += stats.iterations;
+        result.residual += stats.residual;
+        result.error += stats.error;
+    }
+
+    result.bodies = solver->bodies.size();
+    result.forces = solver->forceCount();
+    ForcePool<Manifold>& manifolds = solver->forcePool<Manifold>();
+    for (int i = 0; i < manifolds.size(); i++)
+        result.contacts += manifolds[i]->numContacts;
+    result.checksum = checksum(solver);
+
+    if (steps > 0)
+    {
+        double total = 0;
+        for (double t : times)
+            total += t;
+
+        std::sort(times.begin(), times.end());
+        result.mean = total / steps;
+        result.median = steps % 2 ? times[steps / 2] : (times[steps / 2 - 1] + times[steps / 2]) * 0.5;
+        result.p99 = times[std::min(steps - 1, (int)ceil(steps * 0.99) - 1)];
+        result.stepsPerSecond = total > 0 ? steps / (total / 1000.0) : 0;
+
+        for (int p = 0; p < PHASE_COUNT; p++)
+            result.phases[p] /= steps;
+        result.pairsTested /= steps;
+        result.manifoldsCreated /= steps;
+        result.manifoldsDestroyed /= steps;
+        result.primalRows /= steps;
+        result.dualRows /= steps;
+        result.solves /= steps;
+        result.awakeBodies /= steps;
+        result.islands /= steps;
+        result.iterations /= steps;
+        result.residual /= steps;
+        result.error /= steps;
+        result.cacheMisses /= steps;
+    }
+    if (!counter.available())
+        result.cacheMisses = -1;
+
+    delete solver;
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config = { 600, 0, 1, false, 0, true, false, false, 10, 0.0f };
+    bool json = false;
+    std::vector<int> selected;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+            config.steps = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            config.warmup = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            config.threads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            config.iterations = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+            config.budget = std::max(0.0f, (float)atof(argv[++i]));
+        else if (strcmp(argv[i], "--reorder") == 0 && i + 1 < argc)
+            config.reorder = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--tree") == 0)
+            config.tree = true;
+        else if (strcmp(argv[i], "--no-sleep") == 0)
+            config.sleep = false;
+        else if (strcmp(argv[i], "--adaptive") == 0)
+            config.adaptive = true;
+        else if (strcmp(argv[i], "--chebyshev") == 0)
+            config.chebyshev = true;
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+        {
+            int scene = findScene(argv[++i]);
+            if (scene < 0)
+            {
+                fprintf(stderr, "Unknown scene: %s\n", argv[i]);
+                return 1;
+            }
+            selected.push_back(scene);
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            for (int j = 0; j < sceneCount; j++)
+                printf("%d %s\n", j, sceneNames[j]);
+            return 0;
+        }
+        else
+        {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (selected.empty())
+        for (int i = 0; i < sceneCount; i++)
+            selected.push_back(i);
+
+    if (json)
+        printf("[\n");
+    else
+    {
+        printf("scene,steps,bodies,forces,contacts,mean_ms,median_ms,p99_ms,steps_per_sec,checksum");
+        for (int p = 0; p < PHASE_COUNT; p++)
+            printf(",%s_ms", phaseNames[p]);
+        printf(",pairs_tested,manifolds_created,manifolds_destroyed,primal_rows,dual_rows,solves,awake_bodies,islands,iterations,residual,error,cache_misses\n");
+    }
+
+    for (size_t i = 0; i < selected.size(); i++)
+    {
+        BenchResult r = run(selected[i], config);
+        if (json)
+        {
+            printf("  { \"scene\": \"%s\", \"steps\": %d, \"bodies\": %d, \"forces\": %d, \"contacts\": %d, "
+                "\"mean_ms\": %.6f, \"median_ms\": %.6f, \"p99_ms\": %.6f, \"steps_per_sec\": %.2f, \"checksum\": \"%08x\"",
+                r.name, r.steps, r.bodies, r.forces, r.contacts, r.mean, r.median, r.p99, r.stepsPerSecond, r.checksum);
+            for (int p = 0; p < PHASE_COUNT; p++)
+                printf(", \"%s_ms\": %.6f", phaseNames[p], r.phases[p]);
+            printf(", \"pairs_tested\": %.1f, \"manifolds_created\": %.1f, \"manifolds_destroyed\": %.1f, "
+                "\"primal_rows\": %.1f, \"dual_rows\": %.1f, \"solves\": %.1f, \"awake_bodies\": %.1f, \"islands\": %.1f, "
+                "\"iterations\": %.2f, \"residual\": %g, \"error\": %g, \"cache_misses\": %.1f }%s\n",
+                r.pairsTested, r.manifoldsCreated, r.manifoldsDestroyed, r.primalRows, r.dualRows, r.solves,
+                r.awakeBodies, r.islands, r.iterations, r.residual, r.error, r.cacheMisses,
+                i + 1 < selected.size() ? "," : "");
+        }
+        else
+        {
+            printf("%s,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.2f,%08x",
+                r.name, r.steps, r.bodies, r.forces, r.contacts, r.mean, r.median, r.p99, r.stepsPerSecond, r.checksum);
+            for (int p = 0; p < PHASE_COUNT; p++)
+                printf(",%.6f", r.phases[p]);
+            printf(",%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f,%g,%g,%.1f\n",
+                r.pairsTested, r.manifoldsCreated, r.manifoldsDestroyed, r.primalRows, r.dualRows, r.solves,
+                r.awakeBodies, r.islands, r.iterations, r.residual, r.error, r.cacheMisses);
+        }
+        fflush(stdout);
+    }
+
+    if (json)
+        printf("]\n");
+
+    return 0;
+}
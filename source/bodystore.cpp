@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#include "solver.h"
+
+// Gathers the elements of an array in the given order
+template <typename T>
+static void gather(std::vector<T>& values, const std::vector<int>& order, std::vector<T>& scratch)
+{
+    scratch.resize(values.size());
+    for (int i = 0; i < (int)order.size(); i++)
+        scratch[i] = values[order[i]];
+    values.swap(scratch);
+}
+
+BodyStore::BodyStore()
+    : freeSlot(-1)
+{
+}
+
+int BodyStore::create(Rigid* body)
+{
+    // Reuse a free handle if there is one
+    int handle = freeSlot;
+    if (handle != -1)
+        freeSlot = slots[handle];
+    else
+    {
+        handle = (int)slots.size();
+        slots.push_back(0);
+    }
+
+    // Append the body to the end of the arrays
+    slots[handle] = size();
+    position.push_back({});
+    initial.push_back({});
+    inertial.push_back({});
+    velocity.push_back({});
+    prevVelocity.push_back({});
+    mass.push_back(0);
+    moment.push_back(0);
+    rotation.push_back({ 1, 0, 0, 1 });
+    sleepTime.push_back(0);
+    asleep.push_back(0);
+    rigid.push_back(body);
+    handles.push_back(handle);
+    return handle;
+}
+
+void BodyStore::remove(int handle)
+{
+    // Move the last body into the removed index, so the arrays stay packed
+    int index = slots[handle];
+    int last = size() - 1;
+    if (index != last)
+    {
+        position[index] = position[last];
+        initial[index] = initial[last];
+        inertial[index] = inertial[last];
+        velocity[index] = velocity[last];
+        prevVelocity[index] = prevVelocity[last];
+        mass[index] = mass[last];
+        moment[index] = moment[last];
+        rotation[index] = rotation[last];
+        sleepTime[index] = sleepTime[last];
+        asleep[index] = asleep[last];
+        rigid[index] = rigid[last];
+        handles[index] = handles[last];
+        slots[handles[index]] = index;
+    }
+
+    position.pop_back();
+    initial.pop_back();
+    inertial.pop_back();
+    velocity.pop_back();
+    prevVelocity.pop_back();
+    mass.pop_back();
+    moment.pop_back();
+    rotation.pop_back();
+    sleepTime.pop_back();
+    asleep.pop_back();
+    rigid.pop_back();
+    handles.pop_back();
+
+    // Add the handle to the free list
+    slots[handle] = freeSlot;
+    freeSlot = handle;
+}
+
+void BodyStore::permute(const std::vector<int>& order)
+{
+    std::vector<float3> scratch3;
+    gather(position, order, scratch3);
+    gather(initial, order, scratch3);
+    gather(inertial, order, scratch3);
+    gather(velocity, order, scratch3);
+    gather(prevVelocity, order, scratch3);
+
+    std::vector<float> scratch1;
+    gather(mass, order, scratch1);
+    gather(moment, order, scratch1);
+    gather(sleepTime, order, scratch1);
+
+    std::vector<float2x2> scratchRotation;
+    gather(rotation, order, scratchRotation);
+
+    std::vector<uint8_t> scratchByte;
+    gather(asleep, order, scratchByte);
+
+    std::vector<Rigid*> scratchRigid;
+    gather(rigid, order, scratchRigid);
+
+    std::vector<int> scratchInt;
+    gather(handles, order, scratchInt);
+
+    // Point the handles at the new indices
+    for (int i = 0; i < size(); i++)
+        slots[handles[i]] = i;
+}
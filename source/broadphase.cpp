@@ -0,0 +1,198 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#include <algorithm>
+
+#include "solver.h"
+
+Broadphase::Broadphase()
+    : treeDirty(false), useTree(false)
+{
+}
+
+AABB Broadphase::bounds(Rigid* body)
+{
+    // The bounding circle is rotation invariant, so its box is cheap to compute
+    float2 r = { body->radius, body->radius };
+    return { body->position().xy() - r, body->position().xy() + r };
+}
+
+void Broadphase::add(Rigid* body)
+{
+    // Reuse a free proxy if there is one
+    if (!freeProxies.empty())
+    {
+        body->proxy = freeProxies.back();
+        freeProxies.pop_back();
+    }
+    else
+    {
+        body->proxy = (int)proxies.size();
+        proxies.push_back({});
+    }
+
+    proxies[body->proxy].body = body;
+    proxies[body->proxy].leaf = tree.insert(body, bounds(body));
+    added.push_back(body->proxy);
+}
+
+void Broadphase::remove(Rigid* body)
+{
+    // The proxy is dropped from the sorted order lazily on the next update, and only reused after that
+    tree.remove(proxies[body->proxy].leaf);
+    proxies[body->proxy].body = 0;
+    removed.push_back(body->proxy);
+}
+
+void Broadphase::refit(const BodyStore& bodies)
+{
+    // Only bodies which have left their fat box are reinserted. Sleeping bodies don't move.
+    for (int i = 0; i < bodies.size(); i++)
+        if (!bodies.asleep[i])
+            tree.move(proxies[bodies.rigid[i]->proxy].leaf, bounds(bodies.rigid[i]));
+    treeDirty = false;
+}
+
+void Broadphase::update(const BodyStore& bodies, StepStats& stats)
+{
+    // Refresh the bounds of all bodies.
+    // The rank is the index of the body in the body store, which is used to order the output pairs.
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        Proxy& p = proxies[bodies.rigid[i]->proxy];
+        float2 center = bodies.position[i].xy();
+        float2 r = { bodies.rigid[i]->radius, bodies.rigid[i]->radius };
+        AABB box = { center - r, center + r };
+        p.minX = box.min.x - BROADPHASE_MARGIN;
+        p.maxX = box.max.x + BROADPHASE_MARGIN;
+        p.minY = box.min.y - BROADPHASE_MARGIN;
+        p.maxY = box.max.y + BROADPHASE_MARGIN;
+        p.rank = i;
+        p.asleep = bodies.asleep[i] != 0;
+        p.awake = bodies.mass[i] > 0 && !bodies.asleep[i];
+    }
+
+    // Drop removed proxies and append new ones
+    if (!removed.empty())
+    {
+        int count = 0;
+        for (int i = 0; i < (int)order.size(); i++)
+            if (proxies[order[i]].body)
+                order[count++] = order[i];
+        order.resize(count);
+    }
+
+    int numAdded = 0;
+    for (int i = 0; i < (int)added.size(); i++)
+    {
+        if (proxies[added[i]].body)
+        {
+            order.push_back(added[i]);
+            numAdded++;
+        }
+    }
+
+    freeProxies.insert(freeProxies.end(), removed.begin(), removed.end());
+    removed.clear();
+    added.clear();
+
+    pairs.clear();
+    if (useTree)
+    {
+        refit(bodies);
+        queryTree(bodies, stats);
+    }
+    else
+    {
+        auto less = [this](int a, int b) { return proxies[a].minX < proxies[b].minX; };
+
+        // Sort by minX. Bodies move little between steps, so an insertion sort is near linear.
+        // If many bodies were added (eg a scene was just created), a full sort is cheaper.
+        if (numAdded > (int)order.size() / 4)
+            std::sort(order.begin(), order.end(), less);
+        else
+        {
+            for (int i = 1; i < (int)order.size(); i++)
+            {
+                int key = order[i];
+                int j = i - 1;
+                while (j >= 0 && less(key, order[j]))
+                {
+                    order[j + 1] = order[j];
+                    j--;
+                }
+                order[j + 1] = key;
+            }
+        }
+
+        sweep(stats);
+    }
+
+    // Report pairs in the order of a nested loop over the body store, so results do not depend on the method used
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) {
+        return a.rankA != b.rankA ? a.rankA < b.rankA : a.rankB < b.rankB;
+    });
+}
+
+void Broadphase::sweep(StepStats& stats)
+{
+    // Sweep along x, only testing pairs whose intervals overlap
+    for (int i = 0; i < (int)order.size(); i++)
+    {
+        const Proxy& a = proxies[order[i]];
+        for (int j = i + 1; j < (int)order.size(); j++)
+        {
+            const Proxy& b = proxies[order[j]];
+            if (b.minX > a.maxX)
+                break;
+            if (b.minY > a.maxY || b.maxY < a.minY)
+                continue;
+            testPair(a, b, stats);
+        }
+    }
+}
+
+void Broadphase::queryTree(const BodyStore& bodies, StepStats& stats)
+{
+    // Query the tree with the bounds of each body. Each pair is found from both sides, so only test it from the first.
+    // Sleeping bodies don't query, so their pairs with awake bodies are tested from the awake side.
+    for (Rigid* body : bodies.rigid)
+    {
+        const Proxy& a = proxies[body->proxy];
+        if (a.asleep)
+            continue;
+        AABB box = { float2{ a.minX, a.minY }, float2{ a.maxX, a.maxY } };
+        tree.query(box, [&](Rigid* other) {
+            const Proxy& b = proxies[other->proxy];
+            if (b.rank > a.rank || b.asleep)
+                testPair(a, b, stats);
+            return true;
+        });
+    }
+}
+
+void Broadphase::testPair(const Proxy& a, const Proxy& b, StepStats& stats)
+{
+    // A sleeping body can only start touching a body which is awake
+    if ((a.asleep && !b.awake) || (b.asleep && !a.awake))
+        return;
+
+    // Same bounding circle test as a naive all pairs loop, so exactly the same pairs are found
+    STATS_ADD(stats, pairsTested, 1);
+    const Proxy& first = a.rank < b.rank ? a : b;
+    const Proxy& second = a.rank < b.rank ? b : a;
+    Rigid* bodyA = first.body;
+    Rigid* bodyB = second.body;
+    float2 dp = bodyA->position().xy() - bodyB->position().xy();
+    float r = bodyA->radius + bodyB->radius;
+    if (dot(dp, dp) <= r * r && bodyA->collidesWith(bodyB) && !bodyA->constrainedTo(bodyB))
+        pairs.push_back({ bodyA, bodyB, first.rank, second.rank });
+}
@@ -26,6 +26,7 @@ SOFTWARE.
 */
 
 #include "solver.h"
+#include "simd.h"
 
 // Box vertex and edge numbering:
 //
@@ -172,40 +173,123 @@ static void ComputeIncidentEdge(ClipVertex c[2], const float2& h, const float2&
 	c[1].v = pos + Rot * c[1].v;
 }
 
-// The normal points from A to B
-int Manifold::collide(Rigid* bodyA, Rigid* bodyB, Contact* contacts)
+// Box pair state shared by the separating axis test and clipping
+struct BoxPair
 {
-	float2 normal;
+	float2 hA, hB;
+	float2 posA, posB;
+	float2x2 RotA, RotB;
 
-	// Setup
-	float2 hA = bodyA->size * 0.5f;
-	float2 hB = bodyB->size * 0.5f;
+	// Filled by the separating axis test
+	float2 dA, dB;
+	float2 faceA, faceB;
+};
 
-	float2 posA = bodyA->position.xy();
-	float2 posB = bodyB->position.xy();
+static void SetupPair(BoxPair& p, Rigid* bodyA, Rigid* bodyB)
+{
+	p.hA = bodyA->size * 0.5f;
+	p.hB = bodyB->size * 0.5f;
 
-	float2x2 RotA = rotation(bodyA->position.z), RotB = rotation(bodyB->position.z);
+	p.posA = bodyA->position().xy();
+	p.posB = bodyB->position().xy();
 
-	float2x2 RotAT = transpose(RotA);
-	float2x2 RotBT = transpose(RotB);
+	p.RotA = bodyA->rotation();
+	p.RotB = bodyB->rotation();
+}
+
+// Returns true if one of the face axes separates the boxes
+static bool Separated(BoxPair& p)
+{
+	float2x2 RotAT = transpose(p.RotA);
+	float2x2 RotBT = transpose(p.RotB);
 
-	float2 dp = posB - posA;
-	float2 dA = RotAT * dp;
-	float2 dB = RotBT * dp;
+	float2 dp = p.posB - p.posA;
+	p.dA = RotAT * dp;
+	p.dB = RotBT * dp;
 
-	float2x2 C = RotAT * RotB;
+	float2x2 C = RotAT * p.RotB;
 	float2x2 absC = abs(C);
 	float2x2 absCT = transpose(absC);
 
 	// Box A faces
-	float2 faceA = abs(dA) - hA - absC * hB;
-	if (faceA.x > 0.0f || faceA.y > 0.0f)
-		return 0;
+	p.faceA = abs(p.dA) - p.hA - absC * p.hB;
+	if (p.faceA.x > 0.0f || p.faceA.y > 0.0f)
+		return true;
 
 	// Box B faces
-	float2 faceB = abs(dB) - absCT * hA - hB;
-	if (faceB.x > 0.0f || faceB.y > 0.0f)
-		return 0;
+	p.faceB = abs(p.dB) - absCT * p.hA - p.hB;
+	if (p.faceB.x > 0.0f || p.faceB.y > 0.0f)
+		return true;
+
+	return false;
+}
+
+// Same as Separated for one pair per lane, with the same operations in the same order, so the results match exactly
+static void SeparatedBatch(BoxPair* pairs, int count, bool* separated)
+{
+	alignas(32) float in[20][SIMD_WIDTH];
+	for (int l = 0; l < SIMD_WIDTH; l++)
+	{
+		// Unused lanes repeat the first pair
+		const BoxPair& p = pairs[l < count ? l : 0];
+		float2x2 RotAT = transpose(p.RotA);
+		float2x2 RotBT = transpose(p.RotB);
+		in[0][l] = p.hA.x; in[1][l] = p.hA.y; in[2][l] = p.hB.x; in[3][l] = p.hB.y;
+		in[4][l] = p.posA.x; in[5][l] = p.posA.y; in[6][l] = p.posB.x; in[7][l] = p.posB.y;
+		in[8][l] = RotAT[0][0]; in[9][l] = RotAT[0][1]; in[10][l] = RotAT[1][0]; in[11][l] = RotAT[1][1];
+		in[12][l] = RotBT[0][0]; in[13][l] = RotBT[0][1]; in[14][l] = RotBT[1][0]; in[15][l] = RotBT[1][1];
+		in[16][l] = p.RotB[0][0]; in[17][l] = p.RotB[0][1]; in[18][l] = p.RotB[1][0]; in[19][l] = p.RotB[1][1];
+	}
+
+	floatv hAx = floatv::load(in[0]), hAy = floatv::load(in[1]), hBx = floatv::load(in[2]), hBy = floatv::load(in[3]);
+	floatv AT00 = floatv::load(in[8]), AT01 = floatv::load(in[9]), AT10 = floatv::load(in[10]), AT11 = floatv::load(in[11]);
+	floatv BT00 = floatv::load(in[12]), BT01 = floatv::load(in[13]), BT10 = floatv::load(in[14]), BT11 = floatv::load(in[15]);
+	floatv B00 = floatv::load(in[16]), B01 = floatv::load(in[17]), B10 = floatv::load(in[18]), B11 = floatv::load(in[19]);
+
+	floatv dpx = floatv::load(in[6]) - floatv::load(in[4]);
+	floatv dpy = floatv::load(in[7]) - floatv::load(in[5]);
+	floatv dAx = AT00 * dpx + AT01 * dpy;
+	floatv dAy = AT10 * dpx + AT11 * dpy;
+	floatv dBx = BT00 * dpx + BT01 * dpy;
+	floatv dBy = BT10 * dpx + BT11 * dpy;
+
+	floatv absC00 = abs(AT00 * B00 + AT01 * B10);
+	floatv absC01 = abs(AT00 * B01 + AT01 * B11);
+	floatv absC10 = abs(AT10 * B00 + AT11 * B10);
+	floatv absC11 = abs(AT10 * B01 + AT11 * B11);
+
+	alignas(32) float out[8][SIMD_WIDTH];
+	dAx.store(out[0]); dAy.store(out[1]); dBx.store(out[2]); dBy.store(out[3]);
+	(abs(dAx) - hAx - (absC00 * hBx + absC01 * hBy)).store(out[4]);
+	(abs(dAy) - hAy - (absC10 * hBx + absC11 * hBy)).store(out[5]);
+	(abs(dBx) - (absC00 * hAx + absC10 * hAy) - hBx).store(out[6]);
+	(abs(dBy) - (absC01 * hAx + absC11 * hAy) - hBy).store(out[7]);
+
+	for (int l = 0; l < count; l++)
+	{
+		BoxPair& p = pairs[l];
+		p.dA = float2{ out[0][l], out[1][l] };
+		p.dB = float2{ out[2][l], out[3][l] };
+		p.faceA = float2{ out[4][l], out[5][l] };
+		p.faceB = float2{ out[6][l], out[7][l] };
+		separated[l] = p.faceA.x > 0.0f || p.faceA.y > 0.0f || p.faceB.x > 0.0f || p.faceB.y > 0.0f;
+	}
+}
+
+// Computes the contacts of a pair which passed the separating axis test
+static int ClipPair(const BoxPair& p, Manifold::Contact* contacts)
+{
+	float2 normal;
+	const float2& hA = p.hA;
+	const float2& hB = p.hB;
+	const float2& posA = p.posA;
+	const float2& posB = p.posB;
+	const float2x2& RotA = p.RotA;
+	const float2x2& RotB = p.RotB;
+	const float2& dA = p.dA;
+	const float2& dB = p.dB;
+	const float2& faceA = p.faceA;
+	const float2& faceB = p.faceB;
 
 	// Find best axis
 	Axis axis;
@@ -357,4 +441,27 @@ int Manifold::collide(Rigid* bodyA, Rigid* bodyB, Contact* contacts)
 	}
 
 	return numContacts;
-}
\ No newline at end of file
+}
+
+// The normal points from A to B
+int Manifold::collide(Rigid* bodyA, Rigid* bodyB, Contact* contacts)
+{
+	BoxPair pair;
+	SetupPair(pair, bodyA, bodyB);
+	if (Separated(pair))
+		return 0;
+	return ClipPair(pair, contacts);
+}
+
+void Manifold::collideBatch(Manifold* const* manifolds, int count, Contact (*contacts)[2], int* numContacts)
+{
+	BoxPair pairs[SIMD_WIDTH];
+	bool separated[SIMD_WIDTH];
+	for (int i = 0; i < count; i++)
+		SetupPair(pairs[i], manifolds[i]->bodyA, manifolds[i]->bodyB);
+
+	// Only the pairs which aren't separated along a face axis go on to clipping
+	SeparatedBatch(pairs, count, separated);
+	for (int i = 0; i < count; i++)
+		numContacts[i] = separated[i] ? 0 : ClipPair(pairs[i], contacts[i]);
+}
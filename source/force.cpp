@@ -11,75 +11,77 @@
 
 #include "solver.h"
 
-Force::Force(Solver* solver, Rigid* bodyA, Rigid* bodyB)
-    : solver(solver), bodyA(bodyA), bodyB(bodyB), nextA(0), nextB(0)
+// Link of the force in the list of the given body
+static Force*& nextOf(Force* force, Rigid* body)
 {
-    // Add to solver linked list
-    next = solver->forces;
-    solver->forces = this;
+    return force->bodyA == body ? force->nextA : force->nextB;
+}
 
-    // Add to body linked lists
+static Force*& prevOf(Force* force, Rigid* body)
+{
+    return force->bodyA == body ? force->prevA : force->prevB;
+}
+
+Force::Force(Solver* solver, Rigid* bodyA, Rigid* bodyB, int type)
+    : solver(solver), bodyA(bodyA), bodyB(bodyB), nextA(0), nextB(0), prevA(0), prevB(0), type(type), slot(-1)
+{
+    // A new force can't be left between a sleeping body and an awake one (this is how contacts wake bodies)
+    if (bodyA && solver->bodies.asleep[bodyA->index()])
+        solver->wake(bodyA);
+    if (bodyB && solver->bodies.asleep[bodyB->index()])
+        solver->wake(bodyB);
+
+    // Add to the front of the body linked lists
     if (bodyA)
     {
         nextA = bodyA->forces;
+        if (nextA)
+            prevOf(nextA, bodyA) = this;
         bodyA->forces = this;
     }
     if (bodyB)
     {
         nextB = bodyB->forces;
+        if (nextB)
+            prevOf(nextB, bodyB) = this;
         bodyB->forces = this;
     }
 
-    // Set some reasonable defaults
-    for (int i = 0; i < MAX_ROWS; i++)
-    {
-        J[i] = { 0, 0, 0 };
-        H[i] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-        C[i] = 0.0f;
-        stiffness[i] = INFINITY;
-        fmax[i] = INFINITY;
-        fmin[i] = -INFINITY;
-        fracture[i] = INFINITY;
-
-        penalty[i] = 0.0f;
-        lambda[i] = 0.0f;
-    }
+    // Add to the pair table
+    if (bodyA && bodyB)
+        solver->pairs.add(bodyA, bodyB);
 }
 
-
 Force::~Force()
 {
-    // Remove from solver linked list
-    Force** p = &solver->forces;
-    while (*p != this)
-        p = &(*p)->next;
-    *p = next;
-
     // Remove from body linked lists
     if (bodyA)
     {
-        p = &bodyA->forces;
-        while (*p != this)
-            p = (*p)->bodyA == bodyA ? &(*p)->nextA : &(*p)->nextB;
-        *p = nextA;
+        (prevA ? nextOf(prevA, bodyA) : bodyA->forces) = nextA;
+        if (nextA)
+            prevOf(nextA, bodyA) = prevA;
     }
 
     if (bodyB)
     {
-        p = &bodyB->forces;
-        while (*p != this)
-            p = (*p)->bodyA == bodyB ? &(*p)->nextA : &(*p)->nextB;
-        *p = nextB;
+        (prevB ? nextOf(prevB, bodyB) : bodyB->forces) = nextB;
+        if (nextB)
+            prevOf(nextB, bodyB) = prevB;
     }
+
+    // Remove from the pair table
+    if (bodyA && bodyB)
+        solver->pairs.remove(bodyA, bodyB);
 }
 
-void Force::disable()
+void PairTable::add(const Rigid* a, const Rigid* b)
 {
-    // Disable this force by clearing the relavent fields
-    for (int i = 0; i < MAX_ROWS; i++)
-    {
-        stiffness[i] = 0;
-        penalty[i] = 0;
-        lambda[i] = 0;
-    }
+    counts[key(a, b)]++;
+}
+
+void PairTable::remove(const Rigid* a, const Rigid* b)
+{
+    auto it = counts.find(key(a, b));
+    if (--it->second == 0)
+        counts.erase(it);
 }
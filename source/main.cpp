@@ -37,6 +37,7 @@
 
 #include "maths.h"
 #include "solver.h"
+#include "render.h"
 #include "scenes.h"
 
 #define WinWidth 1280
@@ -130,6 +131,20 @@ void ui()
     ImGui::SliderFloat("Gravity", &solver->gravity, -20.0f, 20.0f);
     ImGui::SliderFloat("Dt", &solver->dt, 0.001f, 0.1f);
     ImGui::SliderInt("Iterations", &solver->iterations, 1, 50);
+    ImGui::Checkbox("Adaptive Iterations", &solver->adaptiveIterations);
+    if (solver->adaptiveIterations)
+    {
+        ImGui::SliderInt("Min Iterations", &solver->minIterations, 1, solver->iterations);
+        ImGui::SliderFloat("Tolerance", &solver->tolerance, 0.000001f, 0.01f, "%.6f", ImGuiSliderFlags_Logarithmic);
+        ImGui::Text("Iterations: %d  Residual: %.6f", solver->stats.iterations, solver->stats.residual);
+    }
+    ImGui::SliderFloat("Time Budget (ms)", &solver->timeBudget, 0.0f, 16.0f);
+    if (solver->timeBudget > 0)
+        ImGui::Text("Iterations: %d / %d", solver->stats.iterations, solver->iterations);
+    ImGui::Checkbox("Chebyshev", &solver->chebyshev);
+    if (solver->chebyshev)
+        ImGui::SliderFloat("Spectral Radius", &solver->spectralRadius, 0.0f, 0.99f);
+    ImGui::SliderInt("Threads", &solver->threads, 1, 16);
 
     if (!solver->postStabilize)
         ImGui::SliderFloat("Alpha", &solver->alpha, 0.0f, 1.0f);
@@ -137,6 +152,8 @@ void ui()
     ImGui::SliderFloat("Gamma", &solver->gamma, 0.0f, 1.0f);
 
     ImGui::Checkbox("Post Stabilize", &solver->postStabilize);
+    ImGui::Checkbox("Tree Broadphase", &solver->broadphase.useTree);
+    ImGui::Checkbox("Sleep", &solver->enableSleep);
 
     ImGui::End();
 }
@@ -179,7 +196,10 @@ void input()
                 drag = new Joint(solver, 0, b, mousePos, local, float3{ 1000.0f, 1000.0f, 0.0f });
         }
         else
+        {
             drag->rA = mousePos;
+            solver->wake(drag->bodyB);
+        }
     }
     else if (drag)
     {
@@ -309,7 +329,7 @@ void mainLoop()
     // Step solver and draw it
     if (!paused)
         solver->step();
-    solver->draw();
+    draw(solver);
 
     // ImGUI rendering
     ImGui::Render();
@@ -10,15 +10,33 @@
 */
 
 #include "solver.h"
+#include "simd.h"
 
 Manifold::Manifold(Solver* solver, Rigid* bodyA, Rigid* bodyB)
-    : Force(solver, bodyA, bodyB), numContacts(0)
+    : TypedForce(solver, bodyA, bodyB), numContacts(0), separatedFrames(0), changed(false)
 {
     fmax[0] = fmax[2] = 0.0f;
     fmin[0] = fmin[2] = -INFINITY;
 }
 
 bool Manifold::initialize()
+{
+    // Compute new contacts
+    Contact found[2];
+    int count = collide(bodyA, bodyB, found);
+    return update(found, count);
+}
+
+void Manifold::initializeBatch(Manifold* const* manifolds, int count, bool* active)
+{
+    Contact found[SIMD_WIDTH][2];
+    int numFound[SIMD_WIDTH];
+    collideBatch(manifolds, count, found, numFound);
+    for (int i = 0; i < count; i++)
+        active[i] = manifolds[i]->update(found[i], numFound[i]);
+}
+
+bool Manifold::update(const Contact* found, int count)
 {
     // Compute friction
     friction = sqrtf(bodyA->friction * bodyB->friction);
@@ -30,12 +48,21 @@ bool Manifold::initialize()
     bool oldStick[2] = { contacts[0].stick, contacts[1].stick };
     int oldNumContacts = numContacts;
 
-    // Compute new contacts
-    numContacts = collide(bodyA, bodyB, contacts);
+    // Take the new contacts
+    numContacts = count;
+    for (int i = 0; i < numContacts; i++)
+    {
+        contacts[i].feature = found[i].feature;
+        contacts[i].rA = found[i].rA;
+        contacts[i].rB = found[i].rB;
+        contacts[i].normal = found[i].normal;
+    }
 
     // Merge old contact data with new contacts
+    changed = numContacts != oldNumContacts;
     for (int i = 0; i < numContacts; i++)
     {
+        bool matched = false;
         penalty[i * 2 + 0] = penalty[i * 2 + 1] = 0.0f;
         lambda[i * 2 + 0] = lambda[i * 2 + 1] = 0.0f;
 
@@ -43,6 +70,7 @@ bool Manifold::initialize()
         {
             if (contacts[i].feature.value == oldContacts[j].feature.value)
             {
+                matched = true;
                 penalty[i * 2 + 0] = oldPenalty[j * 2 + 0];
                 penalty[i * 2 + 1] = oldPenalty[j * 2 + 1];
                 lambda[i * 2 + 0] = oldLambda[j * 2 + 0];
@@ -57,6 +85,7 @@ bool Manifold::initialize()
                 }
             }
         }
+        changed = changed || !matched;
     }
 
     for (int i = 0; i < numContacts; i++)
@@ -69,20 +98,20 @@ bool Manifold::initialize()
             tangent.x, tangent.y
         };
 
-        float2 rAW = rotate(bodyA->position.z, contacts[i].rA);
-        float2 rBW = rotate(bodyB->position.z, contacts[i].rB);
+        float2 rAW = bodyA->rotate(contacts[i].rA);
+        float2 rBW = bodyB->rotate(contacts[i].rB);
 
         // Precompute the constraint and derivatives at C(x-), since we use a truncated Taylor series for contacts (Sec 4).
         // Note that we discard the second order term, since it is insignificant for contacts
-        contacts[i].JAn = { basis[0][0], basis[0][1], cross(rAW, normal) };
-        contacts[i].JBn = { -basis[0][0], -basis[0][1], -cross(rBW, normal) };
-        contacts[i].JAt = { basis[1][0], basis[1][1], cross(rAW, tangent) };
-        contacts[i].JBt = { -basis[1][0], -basis[1][1], -cross(rBW, tangent) };
+        contacts[i].JA = { cross(rAW, normal), cross(rAW, tangent) };
+        contacts[i].JB = { -cross(rBW, normal), -cross(rBW, tangent) };
 
-        contacts[i].C0 = basis * (bodyA->position.xy() + rAW - bodyB->position.xy() - rBW) + float2{ COLLISION_MARGIN, 0 };
+        contacts[i].C0 = basis * (bodyA->position().xy() + rAW - bodyB->position().xy() - rBW) + float2{ COLLISION_MARGIN, 0 };
     }
 
-    return numContacts > 0;
+    // Keep the manifold for a few steps after the bodies separate, in case they touch again
+    separatedFrames = numContacts > 0 ? 0 : separatedFrames + 1;
+    return separatedFrames <= solver->keepAlive;
 }
 
 void Manifold::computeConstraint(float alpha)
@@ -90,11 +119,13 @@ void Manifold::computeConstraint(float alpha)
     for (int i = 0; i < numContacts; i++)
     {
         // Compute the Taylor series approximation of the constraint function C(x) (Sec 4)
-        float3 dpA = bodyA->position - bodyA->initial;
-        float3 dpB = bodyB->position - bodyB->initial;
-        
-        C[i * 2 + 0] = contacts[i].C0.x * (1 - alpha) + dot(contacts[i].JAn, dpA) + dot(contacts[i].JBn, dpB);
-        C[i * 2 + 1] = contacts[i].C0.y * (1 - alpha) + dot(contacts[i].JAt, dpA) + dot(contacts[i].JBt, dpB);
+        float3 dpA = bodyA->position() - bodyA->initial();
+        float3 dpB = bodyB->position() - bodyB->initial();
+
+        float3 JAn, JBn, JAt, JBt;
+        jacobians(contacts[i], JAn, JBn, JAt, JBt);
+        C[i * 2 + 0] = contacts[i].C0.x * (1 - alpha) + dot(JAn, dpA) + dot(JBn, dpB);
+        C[i * 2 + 1] = contacts[i].C0.y * (1 - alpha) + dot(JAt, dpA) + dot(JBt, dpB);
 
         // Update the friction bounds using the latest lambda values
         float frictionBound = abs(lambda[i * 2 + 0]) * friction;
@@ -106,38 +137,33 @@ void Manifold::computeConstraint(float alpha)
     }
 }
 
-void Manifold::computeDerivatives(Rigid* body)
+void Manifold::computeDerivatives(Rigid* body, float3* J, float3x3* H)
 {
-    // Just store precomputed derivatives in J for the desired body
+    // Just expand the precomputed derivatives of the desired body. The second order term is discarded for contacts (see initialize).
     for (int i = 0; i < numContacts; i++)
     {
+        float3 JAn, JBn, JAt, JBt;
+        jacobians(contacts[i], JAn, JBn, JAt, JBt);
         if (body == bodyA)
         {
-            J[i * 2 + 0] = contacts[i].JAn;
-            J[i * 2 + 1] = contacts[i].JAt;
+            J[i * 2 + 0] = JAn;
+            J[i * 2 + 1] = JAt;
         }
         else
         {
-            J[i * 2 + 0] = contacts[i].JBn;
-            J[i * 2 + 1] = contacts[i].JBt;
+            J[i * 2 + 0] = JBn;
+            J[i * 2 + 1] = JBt;
         }
     }
 }
 
-void Manifold::draw() const
+void Manifold::jacobians(const Contact& contact, float3& JAn, float3& JBn, float3& JAt, float3& JBt)
 {
-    if (!SHOW_CONTACTS)
-        return;
-
-    for (int i = 0; i < numContacts; i++)
-    {
-        float2 v0 = transform(bodyA->position, contacts[i].rA);
-        float2 v1 = transform(bodyB->position, contacts[i].rB);
-
-        glColor3f(0.75f, 0.0f, 0.0f);
-        glBegin(GL_POINTS);
-        glVertex2f(v0.x, v0.y);
-        glVertex2f(v1.x, v1.y);
-        glEnd();
-    }
+    // The contact basis is the normal and tangent (Eq. 15)
+    float2 normal = contact.normal;
+    float2 tangent = { normal.y, -normal.x };
+    JAn = { normal.x, normal.y, contact.JA.x };
+    JBn = { -normal.x, -normal.y, contact.JB.x };
+    JAt = { tangent.x, tangent.y, contact.JA.y };
+    JBt = { -tangent.x, -tangent.y, contact.JB.y };
 }
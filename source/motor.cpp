@@ -12,7 +12,7 @@
 #include "solver.h"
 
 Motor::Motor(Solver* solver, Rigid* bodyA, Rigid* bodyB, float speed, float maxTorque)
-    : Force(solver, bodyA, bodyB), speed(speed)
+    : TypedForce(solver, bodyA, bodyB), speed(speed)
 {
     fmax[0] = maxTorque;
     fmin[0] = -maxTorque;
@@ -21,25 +21,19 @@ Motor::Motor(Solver* solver, Rigid* bodyA, Rigid* bodyB, float speed, float maxT
 void Motor::computeConstraint(float alpha)
 {
     // Compute delta angular position between the two bodies
-    float dAngleA = (bodyA ? (bodyA->position.z - bodyA->initial.z) : 0.0f);
-    float dAngleB = bodyB->position.z - bodyB->initial.z;
+    float dAngleA = (bodyA ? (bodyA->position().z - bodyA->initial().z) : 0.0f);
+    float dAngleB = bodyB->position().z - bodyB->initial().z;
     float deltaAngle = dAngleA - dAngleB;
 
     // Constraint tries to reach desired angular speed
     C[0] = deltaAngle - speed * solver->dt;
 }
 
-void Motor::computeDerivatives(Rigid* body)
+void Motor::computeDerivatives(Rigid* body, float3* J, float3x3* H)
 {
-    // Compute the first and second derivatives for the desired body
+    // Compute the first derivative for the desired body. The constraint is linear, so it has no hessian.
     if (body == bodyA)
-    {
         J[0] = { 0.0f, 0.0f, 1.0f };
-        H[0] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-    }
     else
-    {
         J[0] = { 0.0f, 0.0f, -1.0f };
-        H[0] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-    }
 }
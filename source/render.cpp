@@ -0,0 +1,108 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#ifdef TARGET_OS_MAC
+#include <OpenGL/GL.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include "render.h"
+
+static void drawRigid(const Rigid* body)
+{
+    float2x2 R = rotation(body->position().z);
+    float2 v0 = R * float2{ -body->size.x * 0.5f, -body->size.y * 0.5f } + body->position().xy();
+    float2 v1 = R * float2{ body->size.x * 0.5f, -body->size.y * 0.5f } + body->position().xy();
+    float2 v2 = R * float2{ body->size.x * 0.5f, body->size.y * 0.5f } + body->position().xy();
+    float2 v3 = R * float2{ -body->size.x * 0.5f, body->size.y * 0.5f } + body->position().xy();
+
+    glColor3f(0.6f, 0.6f, 0.6f);
+    glBegin(GL_QUADS);
+    glVertex2f(v0.x, v0.y);
+    glVertex2f(v1.x, v1.y);
+    glVertex2f(v2.x, v2.y);
+    glVertex2f(v3.x, v3.y);
+    glEnd();
+
+    glColor3f(0, 0, 0);
+    glBegin(GL_LINE_LOOP);
+    glVertex2f(v0.x, v0.y);
+    glVertex2f(v1.x, v1.y);
+    glVertex2f(v2.x, v2.y);
+    glVertex2f(v3.x, v3.y);
+    glEnd();
+}
+
+static void drawJoint(const Joint* joint)
+{
+    float2 v0 = joint->bodyA ? transform(joint->bodyA->position(), joint->rA) : joint->rA;
+    float2 v1 = transform(joint->bodyB->position(), joint->rB);
+
+    glColor3f(0.75f, 0.0f, 0.0f);
+    glBegin(GL_LINES);
+    glVertex2f(v0.x, v0.y);
+    glVertex2f(v1.x, v1.y);
+    glEnd();
+}
+
+static void drawSpring(const Spring* spring)
+{
+    float2 v0 = transform(spring->bodyA->position(), spring->rA);
+    float2 v1 = transform(spring->bodyB->position(), spring->rB);
+
+    glColor3f(0.75f, 0.0f, 0.0f);
+    glBegin(GL_LINES);
+    glVertex2f(v0.x, v0.y);
+    glVertex2f(v1.x, v1.y);
+    glEnd();
+}
+
+static void drawManifold(const Manifold* manifold)
+{
+    if (!SHOW_CONTACTS)
+        return;
+
+    for (int i = 0; i < manifold->numContacts; i++)
+    {
+        float2 v0 = transform(manifold->bodyA->position(), manifold->contacts[i].rA);
+        float2 v1 = transform(manifold->bodyB->position(), manifold->contacts[i].rB);
+
+        glColor3f(0.75f, 0.0f, 0.0f);
+        glBegin(GL_POINTS);
+        glVertex2f(v0.x, v0.y);
+        glVertex2f(v1.x, v1.y);
+        glEnd();
+    }
+}
+
+void draw(Solver* solver)
+{
+    for (Rigid* body : solver->bodies.rigid)
+        drawRigid(body);
+
+    // Only forces with a visual representation are drawn
+    ForcePool<Joint>& joints = solver->forcePool<Joint>();
+    for (int i = 0; i < joints.size(); i++)
+        drawJoint(joints[i]);
+    ForcePool<Spring>& springs = solver->forcePool<Spring>();
+    for (int i = 0; i < springs.size(); i++)
+        drawSpring(springs[i]);
+    ForcePool<Manifold>& manifolds = solver->forcePool<Manifold>();
+    for (int i = 0; i < manifolds.size(); i++)
+        drawManifold(manifolds[i]);
+}
@@ -0,0 +1,20 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#pragma once
+
+#include "solver.h"
+
+#define SHOW_CONTACTS true            // Whether to show contacts in the debug draw
+
+// Debug draw of all the bodies and forces in the solver using immediate mode OpenGL.
+// This lives outside of the simulation core so that the solver can be built without any graphics dependencies.
+void draw(Solver* solver);
@@ -12,57 +12,69 @@
 #include "solver.h"
 
 Rigid::Rigid(Solver* solver, float2 size, float density, float friction, float3 position, float3 velocity)
-    : solver(solver), forces(0), next(0), position(position), velocity(velocity), prevVelocity(velocity), size(size), friction(friction)
+    : solver(solver), forces(0), size(size), friction(friction), color(-1), category(1), mask(0xFFFFFFFF)
 {
-    // Add to linked list
-    next = solver->bodies;
-    solver->bodies = this;
+    // Add to the body store
+    handle = solver->bodies.create(this);
+    this->position() = position;
+    this->rotation() = ::rotation(position.z);
+    this->velocity() = velocity;
+    this->prevVelocity() = velocity;
 
     // Compute mass properties and bounding radius
-    mass = size.x * size.y * density;
-    moment = mass * dot(size, size) / 12.0f;
+    mass() = size.x * size.y * density;
+    moment() = mass() * dot(size, size) / 12.0f;
     radius = length(size * 0.5f);
+
+    // Register with the broadphase
+    solver->broadphase.add(this);
 }
 
 Rigid::~Rigid()
 {
-    // Remove from linked list
-    Rigid** p = &solver->bodies;
-    while (*p != this)
-        p = &(*p)->next;
-    *p = next;
+    // Anything resting on this body needs to react to its removal. Static bodies never sleep, so wake the
+    // other body of each force rather than relying on this body's island.
+    solver->wake(this);
+
+    // Destroy the forces acting on this body, which can't outlive it
+    while (forces)
+    {
+        solver->wake(forces->bodyA == this ? forces->bodyB : forces->bodyA);
+        solver->destroy(forces);
+    }
+
+    // Remove from the body store
+    solver->bodies.remove(handle);
+
+    // Remove from the broadphase
+    solver->broadphase.remove(this);
+
+    // Remove any collision filter pairs
+    for (Rigid* other : ignored)
+    {
+        solver->ignoredPairs.remove(this, other);
+        for (int i = 0; i < (int)other->ignored.size(); i++)
+        {
+            if (other->ignored[i] == this)
+            {
+                other->ignored[i] = other->ignored.back();
+                other->ignored.pop_back();
+                break;
+            }
+        }
+    }
 }
 
 bool Rigid::constrainedTo(Rigid* other) const
 {
     // Check if this body is constrained to the other body
-    for (Force* f = forces; f != 0; f = f->next)
-        if ((f->bodyA == this && f->bodyB == other) || (f->bodyA == other && f->bodyB == this))
-            return true;
-    return false;
+    return solver->pairs.contains(this, other);
 }
 
-void Rigid::draw()
+bool Rigid::collidesWith(Rigid* other) const
 {
-    float2x2 R = rotation(position.z);
-    float2 v0 = R * float2{ -size.x * 0.5f, -size.y * 0.5f } + position.xy();
-    float2 v1 = R * float2{ size.x * 0.5f, -size.y * 0.5f } + position.xy();
-    float2 v2 = R * float2{ size.x * 0.5f, size.y * 0.5f } + position.xy();
-    float2 v3 = R * float2{ -size.x * 0.5f, size.y * 0.5f } + position.xy();
-
-    glColor3f(0.6f, 0.6f, 0.6f);
-    glBegin(GL_QUADS);
-    glVertex2f(v0.x, v0.y);
-    glVertex2f(v1.x, v1.y);
-    glVertex2f(v2.x, v2.y);
-    glVertex2f(v3.x, v3.y);
-    glEnd();
-
-    glColor3f(0, 0, 0);
-    glBegin(GL_LINE_LOOP);
-    glVertex2f(v0.x, v0.y);
-    glVertex2f(v1.x, v1.y);
-    glVertex2f(v2.x, v2.y);
-    glVertex2f(v3.x, v3.y);
-    glEnd();
+    // Check the category bits and explicitly ignored pairs
+    if ((category & other->mask) == 0 || (other->category & mask) == 0)
+        return false;
+    return ignored.empty() || !solver->ignoredPairs.contains(this, other);
 }
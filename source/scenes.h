@@ -177,8 +177,8 @@ static void sceneSoftBody(Solver* solver)
         {
             for (int y = 1; y < H; y++)
             {
-                new IgnoreCollision(solver, grid[x - 1][y - 1], grid[x][y]);
-                new IgnoreCollision(solver, grid[x][y - 1], grid[x - 1][y]);
+                solver->ignoreCollision(grid[x - 1][y - 1], grid[x][y]);
+                solver->ignoreCollision(grid[x][y - 1], grid[x - 1][y]);
             }
         }
     }
@@ -208,8 +208,8 @@ static void sceneJointGrid(Solver* solver)
     {
         for (int y = 1; y < H; y++)
         {
-            new IgnoreCollision(solver, grid[x - 1][y - 1], grid[x][y]);
-            new IgnoreCollision(solver, grid[x][y - 1], grid[x - 1][y]);
+            solver->ignoreCollision(grid[x - 1][y - 1], grid[x][y]);
+            solver->ignoreCollision(grid[x][y - 1], grid[x - 1][y]);
         }
     }
 }
@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#pragma once
+
+#include <math.h>
+
+// Small vector of floats for the batched solver kernels, which solve one body per lane. Uses AVX or SSE when
+// the compiler targets them, and plain loops otherwise. Define AVBD_SIMD to 0 to always use the plain loops.
+#ifndef AVBD_SIMD
+#define AVBD_SIMD 1
+#endif
+
+#if AVBD_SIMD && defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 8
+#elif AVBD_SIMD && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define SIMD_WIDTH 4
+#else
+#define SIMD_WIDTH 4
+#define SIMD_SCALAR
+#endif
+
+#if defined(SIMD_SCALAR)
+
+struct floatv
+{
+    float v[SIMD_WIDTH];
+
+    static floatv load(const float* p) { floatv r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < SIMD_WIDTH; i++) p[i] = v[i]; }
+};
+
+#define SIMD_OP(op) \
+inline floatv operator op(floatv a, floatv b) { floatv r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = a.v[i] op b.v[i]; return r; }
+SIMD_OP(+)
+SIMD_OP(-)
+SIMD_OP(*)
+SIMD_OP(/)
+#undef SIMD_OP
+
+inline floatv abs(floatv a) { floatv r; for (int i = 0; i < SIMD_WIDTH; i++) r.v[i] = fabsf(a.v[i]); return r; }
+
+#elif SIMD_WIDTH == 8
+
+struct floatv
+{
+    __m256 v;
+
+    static floatv load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline floatv operator+(floatv a, floatv b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline floatv operator-(floatv a, floatv b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline floatv operator*(floatv a, floatv b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline floatv operator/(floatv a, floatv b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline floatv abs(floatv a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+
+#else
+
+struct floatv
+{
+    __m128 v;
+
+    static floatv load(const float* p) { return { _mm_loadu_ps(p) }; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline floatv operator+(floatv a, floatv b) { return { _mm_add_ps(a.v, b.v) }; }
+inline floatv operator-(floatv a, floatv b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline floatv operator*(floatv a, floatv b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline floatv operator/(floatv a, floatv b) { return { _mm_div_ps(a.v, b.v) }; }
+inline floatv abs(floatv a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+
+#endif
+
+inline floatv& operator+=(floatv& a, floatv b) { return a = a + b; }
+
+// Lower triangle of a symmetric 3x3 matrix per lane
+struct sym3x3v
+{
+    floatv a00, a10, a11, a20, a21, a22;
+};
+
+struct float3v
+{
+    floatv x, y, z;
+};
+
+// Solves one SPD 3x3 system per lane, with the same operations in the same order as solve() in maths.h,
+// so each lane gives the same result as the scalar version
+inline float3v solve(const sym3x3v& a, const float3v& b)
+{
+    // Compute LDL^T decomposition
+    floatv D1 = a.a00;
+    floatv L21 = a.a10 / a.a00;
+    floatv L31 = a.a20 / a.a00;
+    floatv D2 = a.a11 - L21 * L21 * D1;
+    floatv L32 = (a.a21 - L21 * L31 * D1) / D2;
+    floatv D3 = a.a22 - (L31 * L31 * D1 + L32 * L32 * D2);
+
+    // Forward substitution: Solve Ly = b
+    floatv y1 = b.x;
+    floatv y2 = b.y - L21 * y1;
+    floatv y3 = b.z - L31 * y1 - L32 * y2;
+
+    // Diagonal solve: Solve Dz = y
+    floatv z1 = y1 / D1;
+    floatv z2 = y2 / D2;
+    floatv z3 = y3 / D3;
+
+    // Backward substitution: Solve L^T x = z
+    float3v x;
+    x.z = z3;
+    x.y = z2 - L32 * x.z;
+    x.x = z1 - L21 * x.y - L31 * x.z;
+
+    return x;
+}
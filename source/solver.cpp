@@ -9,10 +9,21 @@
 * It is provided "as is" without express or implied warranty.
 */
 
+#include <algorithm>
+
 #include "solver.h"
+#include "simd.h"
+
+// Raises an atomic to at least the given value
+static void atomicMax(std::atomic<float>& value, float v)
+{
+    float current = value.load();
+    while (v > current && !value.compare_exchange_weak(current, v))
+        ;
+}
 
 Solver::Solver()
-    : bodies(0), forces(0)
+    : stepIndex(0), islandCount(0), colored(false), stats()
 {
     defaultParams();
 }
@@ -25,24 +36,144 @@ Solver::~Solver()
 Rigid* Solver::pick(float2 at, float2& local)
 {
     // Find which body is at the given point
-    for (Rigid* body = bodies; body != 0; body = body->next)
-    {
-        float2x2 Rt = rotation(-body->position.z);
-        local = Rt * (at - body->position.xy());
+    Rigid* result = 0;
+    if (broadphase.treeDirty)
+        broadphase.refit(bodies);
+    broadphase.tree.query(at, [&](Rigid* body) {
+        float2x2 Rt = rotation(-body->position().z);
+        local = Rt * (at - body->position().xy());
         if (local.x >= -body->size.x * 0.5f && local.x <= body->size.x * 0.5f &&
             local.y >= -body->size.y * 0.5f && local.y <= body->size.y * 0.5f)
-            return body;
+            result = body;
+        return result == 0;
+    });
+    return result;
+}
+
+void Solver::queryPoint(float2 point, std::vector<Rigid*>& results)
+{
+    // Find all bodies containing the given point
+    results.clear();
+    if (broadphase.treeDirty)
+        broadphase.refit(bodies);
+    broadphase.tree.query(point, [&](Rigid* body) {
+        float2 local = rotation(-body->position().z) * (point - body->position().xy());
+        if (fabsf(local.x) <= body->size.x * 0.5f && fabsf(local.y) <= body->size.y * 0.5f)
+            results.push_back(body);
+        return true;
+    });
+}
+
+void Solver::queryAABB(const AABB& box, std::vector<Rigid*>& results)
+{
+    // Find all bodies whose world space bounding box overlaps the given box
+    results.clear();
+    if (broadphase.treeDirty)
+        broadphase.refit(bodies);
+    broadphase.tree.query(box, [&](Rigid* body) {
+        float2 extent = abs(rotation(body->position().z)) * (body->size * 0.5f);
+        AABB bodyBox = { body->position().xy() - extent, body->position().xy() + extent };
+        if (overlaps(box, bodyBox))
+            results.push_back(body);
+        return true;
+    });
+}
+
+void Solver::raycast(const float2* from, const float2* to, RayHit* hits, int count)
+{
+    // Find the closest body along each ray. Rays starting inside a body do not hit it.
+    if (broadphase.treeDirty)
+        broadphase.refit(bodies);
+
+    for (int i = 0; i < count; i++)
+    {
+        RayHit& hit = hits[i];
+        hit.body = 0;
+        hit.point = { 0, 0 };
+        hit.normal = { 0, 0 };
+        hit.fraction = 1.0f;
+
+        broadphase.tree.raycast(from[i], to[i], 1.0f, [&](Rigid* body, float maxFraction) {
+            // Slab test of the ray in the local space of the box
+            float2x2 Rt = rotation(-body->position().z);
+            float2 p = Rt * (from[i] - body->position().xy());
+            float2 d = Rt * (to[i] - from[i]);
+            float2 h = body->size * 0.5f;
+
+            float tmin = 0.0f;
+            float tmax = maxFraction;
+            int axis = -1;
+            for (int j = 0; j < 2; j++)
+            {
+                if (d[j] == 0.0f)
+                {
+                    if (p[j] < -h[j] || p[j] > h[j])
+                        return maxFraction;
+                    continue;
+                }
+
+                float t1 = (-h[j] - p[j]) / d[j];
+                float t2 = (h[j] - p[j]) / d[j];
+                if (min(t1, t2) > tmin)
+                {
+                    tmin = min(t1, t2);
+                    axis = j;
+                }
+                tmax = min(tmax, max(t1, t2));
+                if (tmin > tmax)
+                    return maxFraction;
+            }
+
+            if (axis == -1)
+                return maxFraction;
+
+            float2 normal = { 0, 0 };
+            normal[axis] = d[axis] > 0.0f ? -1.0f : 1.0f;
+
+            hit.body = body;
+            hit.fraction = tmin;
+            hit.point = from[i] + (to[i] - from[i]) * tmin;
+            hit.normal = rotation(body->position().z) * normal;
+            return tmin;
+        });
     }
-    return 0;
+}
+
+void Solver::ignoreCollision(Rigid* bodyA, Rigid* bodyB)
+{
+    // Exclude the pair from the broadphase, without adding anything to the solver
+    if (ignoredPairs.contains(bodyA, bodyB))
+        return;
+    ignoredPairs.add(bodyA, bodyB);
+    bodyA->ignored.push_back(bodyB);
+    bodyB->ignored.push_back(bodyA);
+}
+
+void Solver::destroy(Force* force)
+{
+    ForceTypes::dispatch(force, [&](auto* typed) {
+        forcePool<std::remove_pointer_t<decltype(typed)>>().destroy(typed);
+    });
+}
+
+int Solver::forceCount()
+{
+    int count = 0;
+    forEachPool([&](auto& list) { count += list.size(); });
+    return count;
 }
 
 void Solver::clear()
 {
-    while (forces)
-        delete forces;
+    // Removing the last force of a pool doesn't move any others
+    forEachPool([](auto& list) {
+        while (list.size() > 0)
+            list.destroy(list[list.size() - 1]);
+    });
 
-    while (bodies)
-        delete bodies;
+    // Removing the last body doesn't move any others
+    while (bodies.size() > 0)
+        delete bodies.rigid.back();
 }
 
 void Solver::defaultParams()
@@ -51,6 +182,22 @@ void Solver::defaultParams()
     gravity = -10.0f;
     iterations = 10;
 
+    // Adaptive iteration stops as soon as the largest position update (in meters or radians) and the error of the hard
+    // constraints fall below the tolerance, so resting scenes take only a few iterations. Iterations is then the most taken.
+    adaptiveIterations = false;
+    minIterations = 2;
+    tolerance = 0.0001f;
+
+    // Chebyshev acceleration extrapolates the primal iterations, which converges faster when the spectral radius
+    // is estimated well, and overshoots when it is too high. Stiff joints tolerate much less than soft bodies.
+    // It is skipped in steps where the contacts changed.
+    chebyshev = false;
+    spectralRadius = 0.5f;
+
+    // A time budget (in milliseconds) for the whole step, which stops the iterations early when they wouldn't fit.
+    // Iterations is then the most taken. Zero disables it.
+    timeBudget = 0.0f;
+
     // Note: in the paper, beta is suggested to be [1, 1000]. Technically, the best choice will
     // depend on the length, mass, and constraint function scales (ie units) of your simulation,
     // along with your strategy for incrementing the penalty parameters.
@@ -70,179 +217,1016 @@ void Solver::defaultParams()
     // Post stabilization applies an extra iteration to fix positional error.
     // This removes the need for the alpha parameter, which can make tuning a little easier.
     postStabilize = true;
+
+    // Sorting the bodies spatially helps the cache in large scenes, but changes the Gauss-Seidel order (and so the results)
+    reorderInterval = 0;
+
+    // Keeping manifolds of separated bodies for a few steps avoids recreating them for bodies which are almost touching
+    keepAlive = 3;
+
+    // A single thread keeps the classic Gauss-Seidel ordering of the bodies. With more threads, separate islands are
+    // solved in parallel with the same results, or if one island is too large, the bodies are graph colored and each
+    // color is solved in parallel, which changes the ordering (and so the results). Any number of threads above one gives
+    // the same results.
+    threads = 1;
+
+    // Islands of bodies which have been resting for a while are skipped until something touches them
+    enableSleep = true;
+
+    // The tree broadphase finds the same pairs as sort and sweep, which is usually faster for the scenes in this demo
+    broadphase.useTree = false;
 }
 
 void Solver::step()
 {
-    // Perform broadphase collision detection
-    // This is a naive O(n^2) approach, but it is sufficient for small numbers of bodies in this sample.
-    for (Rigid* bodyA = bodies; bodyA != 0; bodyA = bodyA->next)
+    stats.reset();
+    STATS_TIMER(stats, total);
+
+    // The whole step counts against the time budget
+    deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double, std::milli>(timeBudget));
+
+    // Bodies may have been moved outside of the solver since the last step
+    updateRotations();
+
+    // Periodically sort the bodies spatially
+    if (reorderInterval > 0 && stepIndex % reorderInterval == 0)
+    {
+        STATS_TIMER(stats, time[PHASE_REORDER]);
+        reorder();
+    }
+    stepIndex++;
+
+    // Perform broadphase collision detection, and create manifolds for new overlapping pairs
+    {
+        STATS_TIMER(stats, time[PHASE_BROADPHASE]);
+        broadphase.update(bodies, stats);
+        for (const Broadphase::Pair& pair : broadphase.pairs)
+            forcePool<Manifold>().create(this, pair.bodyA, pair.bodyB);
+        STATS_ADD(stats, manifoldsCreated, (int)broadphase.pairs.size());
+    }
+
+    // Initialize and warmstart forces (ie dual variables)
+    pool.resize(threads);
+    {
+        STATS_TIMER(stats, time[PHASE_INITIALIZE]);
+        forEachPool([&](auto& list) { initialize(list); });
+
+        // Remove the forces which became inactive. This is the only place the solver destroys forces.
+        forEachPool([&](auto& list) { list.compact(); });
+
+        // The set of forces is fixed for the rest of the step, so flatten the body force lists for the solver loops
+        buildAdjacency();
+        buildIslands();
+
+        // Warmstarting only touches the rows of each force, so it can be done in parallel
+        forEachPool([&](auto& list) {
+            pool.parallelFor(list.size(), FORCE_GRAIN, [&](int begin, int end) {
+                for (int i = begin; i < end; i++)
+                    if (!asleep(list.forces[i]))
+                        warmstart(list[i]);
+            });
+        });
+    }
+
+    // Initialize and warmstart bodies (ie primal variables)
     {
-        for (Rigid* bodyB = bodyA->next; bodyB != 0; bodyB = bodyB->next)
+        STATS_TIMER(stats, time[PHASE_WARMSTART]);
+        for (int i = 0; i < bodies.size(); i++)
         {
-            float2 dp = bodyA->position.xy() - bodyB->position.xy();
-            float r = bodyA->radius + bodyB->radius;
-            if (dot(dp, dp) <= r * r && !bodyA->constrainedTo(bodyB))
-                new Manifold(this, bodyA, bodyB);
+            // Sleeping bodies stay where they are
+            if (bodies.asleep[i])
+                continue;
+            STATS_ADD(stats, awakeBodies, (bodies.mass[i] > 0 ? 1 : 0));
+
+            float3& position = bodies.position[i];
+            float3& velocity = bodies.velocity[i];
+
+            // Don't let bodies rotate too fast
+            velocity.z = clamp(velocity.z, -50.0f, 50.0f);
+
+            // Compute inertial position (Eq 2)
+            bodies.inertial[i] = position + velocity * dt;
+            if (bodies.mass[i] > 0)
+                bodies.inertial[i] += float3{ 0, gravity, 0 } * (dt * dt);
+
+            // Adaptive warmstart (See original VBD paper)
+            float3 accel = (velocity - bodies.prevVelocity[i]) / dt;
+            float accelExt = accel.y * sign(gravity);
+            float accelWeight = clamp(accelExt / abs(gravity), 0.0f, 1.0f);
+            if (!isfinite(accelWeight)) accelWeight = 0.0f;
+
+            // Save initial position (x-) and compute warmstarted position (See original VBD paper)
+            bodies.initial[i] = position;
+            position = position + velocity * dt + float3{ 0, gravity, 0 } * (accelWeight * dt * dt);
+            bodies.rotation[i] = rotation(position.z);
         }
     }
 
-    // Initialize and warmstart forces
-    for (Force* force = forces; force != 0;)
+    // With several threads, independent islands are solved in parallel, each exactly as the serial loop would.
+    // If one island holds too much of the work to balance that way, the bodies are graph colored instead. The choice
+    // doesn't depend on the number of threads, so neither do the results (as long as there is more than one).
+    bool parallel = pool.size() > 1;
+    int largest = 0;
+    for (int i = 0; i < islandCount; i++)
+        largest = max(largest, islandOffsets[i + 1] - islandOffsets[i]);
+    bool islandParallel = parallel && islandCount > 1 && largest * ISLAND_SPLIT <= (int)islandBodies.size();
+    colored = parallel && !islandParallel;
+    if (colored)
     {
-        // Initialization can including caching anything that is constant over the step
-        if (!force->initialize())
+        STATS_TIMER(stats, time[PHASE_COLORING]);
+        color();
+    }
+
+    if (chebyshev)
+    {
+        chebyshevPrev.resize(bodies.size());
+        chebyshevPrev2.resize(bodies.size());
+    }
+
+    if (islandParallel)
+    {
+        // The phases of each island are interleaved, so all of the iterations are timed as the primal update
+        STATS_TIMER(stats, time[PHASE_PRIMAL]);
+        islandTasks.resize(islandCount + 1);
+        for (int i = 0; i <= islandCount; i++)
+            islandTasks[i] = i;
+        std::stable_sort(islandTasks.begin(), islandTasks.end(), [&](int a, int b) {
+            return islandOffsets[a + 1] - islandOffsets[a] > islandOffsets[b + 1] - islandOffsets[b];
+        });
+
+        std::mutex statsMutex;
+        pool.parallelTasks((int)islandTasks.size(), [&](int task) {
+            StepStats local = {};
+            solveIsland(islandTasks[task], local);
+
+            std::lock_guard<std::mutex> lock(statsMutex);
+            STATS_ADD(stats, primalRows, local.primalRows);
+            STATS_ADD(stats, dualRows, local.dualRows);
+            STATS_ADD(stats, solves, local.solves);
+            STATS_MAX(stats, iterations, local.iterations);
+            STATS_MAX(stats, residual, local.residual);
+            STATS_MAX(stats, error, local.error);
+        });
+
+        // Static bodies aren't part of any island
+        if (iterations > 0)
         {
-            // Force has returned false meaning it is inactive, so remove it from the solver
-            Force* next = force->next;
-            delete force;
-            force = next;
+            for (int i = 0; i < bodies.size(); i++)
+                if (islandIds[i] < 0 && !bodies.asleep[i])
+                    bodies.prevVelocity[i] = bodies.velocity[i];
         }
-        else
+
+        // Breaking a force changes how its bodies are held, so they shouldn't fall asleep straight away
+        for (Force* force : broken)
+        {
+            wake(force->bodyA);
+            wake(force->bodyB);
+        }
+        broken.clear();
+    }
+    else
+        solveIsland(-1, stats);
+
+    // Put the islands which have been resting long enough to sleep
+    updateSleep();
+
+    // Bodies have moved, so the tree needs to be refit before it is queried again
+    broadphase.treeDirty = true;
+}
+
+void Solver::solveIsland(int island, StepStats& local)
+{
+    // Main solver loop
+    // If using post stabilization, we'll use one extra iteration for the stabilization.
+    // When iterating adaptively, or against a time budget, the count is lowered once the solve has converged or the time is up.
+    int count = iterations;
+    float residual = 0.0f;
+    float lastError = 0.0f;
+
+    // Acceleration assumes the iterations behave the same way from one step to the next, which doesn't hold when contacts change
+    bool accelerated = chebyshev && !contactsChanged(island);
+    float omega = 1.0f;
+    int sequence = 0;
+    float lastDelta = INFINITY;
+    if (accelerated)
+        accelerate(island, omega, true);
+
+    for (int it = 0; it < count + (postStabilize ? 1 : 0); it++)
+    {
+        // If using post stabilization, either remove all or none of the pre-existing constraint error
+        float currentAlpha = alpha;
+        if (postStabilize)
+            currentAlpha = it < count ? 1.0f : 0.0f;
+
+        // The time of each iteration is measured to predict whether another one fits in the time budget
+        auto iterationStart = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration primalTime = {};
+
+        // Largest position update and hard constraint error of this iteration
+        float delta = 0.0f;
+        float error = 0.0f;
+
+        // Primal update
         {
-            for (int i = 0; i < force->rows(); i++)
+            STATS_TIMER(local, time[PHASE_PRIMAL]);
+            if (island >= 0)
+            {
+                // The bodies of an island are in body order, so this matches the serial loop below
+                for (int k = islandOffsets[island]; k < islandOffsets[island + 1]; k++)
+                {
+                    int rows = primalUpdate(islandBodies[k], currentAlpha, delta);
+                    STATS_ADD(local, primalRows, rows);
+                    STATS_ADD(local, solves, 1);
+                }
+            }
+            else if (colored)
             {
-                if (postStabilize)
+                // Bodies of the same color share no forces, so they can be solved in any order, and several at once with SIMD
+                for (int c = 0; c + 1 < (int)colorOffsets.size(); c++)
                 {
-                    // With post stabilization, we can reuse the full lambda from the previous step,
-                    // and only need to reduce the penalty parameters
-                    force->penalty[i] = clamp(force->penalty[i] * gamma, PENALTY_MIN, PENALTY_MAX);
+                    const int* colorBegin = coloredBodies.data() + colorOffsets[c];
+                    int size = colorOffsets[c + 1] - colorOffsets[c];
+                    std::atomic<int> rows(0);
+                    std::atomic<float> largest(delta);
+                    pool.parallelFor(size, PRIMAL_GRAIN, [&](int begin, int end) {
+                        int r = 0;
+                        float d = 0.0f;
+                        for (int i = begin; i < end; i += SIMD_WIDTH)
+                            r += primalUpdateBatch(colorBegin + i, end - i < SIMD_WIDTH ? end - i : SIMD_WIDTH, currentAlpha, d);
+                        rows += r;
+                        atomicMax(largest, d);
+                    });
+                    delta = largest.load();
+                    STATS_ADD(local, primalRows, rows.load());
+                    STATS_ADD(local, solves, size);
+                }
+            }
+            else
+            {
+                for (int i = 0; i < bodies.size(); i++)
+                {
+                    // Skip static / kinematic and sleeping bodies
+                    if (bodies.mass[i] <= 0 || bodies.asleep[i])
+                        continue;
+
+                    int rows = primalUpdate(i, currentAlpha, delta);
+                    STATS_ADD(local, primalRows, rows);
+                    STATS_ADD(local, solves, 1);
                 }
-                else
+            }
+
+            // Chebyshev weights of the VBD paper, which are only used before the post stabilization iteration. The sequence
+            // starts over while the penalties ramp up, and whenever the updates grow, since the dual update changes the system.
+            if (accelerated && it < count)
+            {
+                if (it < CHEBYSHEV_START || delta > lastDelta)
+                    sequence = 0;
+                lastDelta = delta;
+                float rho2 = spectralRadius * spectralRadius;
+                omega = sequence == 0 ? 1.0f : sequence == 1 ? 2.0f / (2.0f - rho2) : 4.0f / (4.0f - rho2 * omega);
+                sequence++;
+                accelerate(island, omega, false);
+            }
+            primalTime = std::chrono::steady_clock::now() - iterationStart;
+        }
+
+        // Dual update, only for non stabilized iterations in the case of post stabilization
+        // If doing more than one post stabilization iteration, we can still do a dual update,
+        // but make sure not to persist the penalty or lambda updates done during the stabilization iterations for the next frame.
+        if (it < count)
+        {
+            STATS_TIMER(local, time[PHASE_DUAL]);
+            if (island >= 0)
+            {
+                // A fractured force only affects itself until the next primal update, so it can be disabled straight away.
+                // Its bodies are woken once all the islands are done.
+                for (int k = islandForceOffsets[island]; k < islandForceOffsets[island + 1]; k++)
                 {
-                    // Warmstart the dual variables and penalty parameters (Eq. 19)
-                    // Penalty is safely clamped to a minimum and maximum value
-                    force->lambda[i] = force->lambda[i] * alpha * gamma;
-                    force->penalty[i] = clamp(force->penalty[i] * gamma, PENALTY_MIN, PENALTY_MAX);
+                    ForceTypes::dispatch(islandForces[k], [&](auto* force) {
+                        STATS_ADD(local, dualRows, force->rows());
+                        if (dualUpdate(force, currentAlpha, error))
+                        {
+                            force->disable();
+                            std::lock_guard<std::mutex> lock(fractureMutex);
+                            broken.push_back(force);
+                        }
+                    });
                 }
+            }
+            else
+                forEachPool([&](auto& list) { dualUpdate(list, currentAlpha, error); });
 
-                // If it's not a hard constraint, we don't let the penalty exceed the material stiffness
-                force->penalty[i] = min(force->penalty[i], force->stiffness[i]);
+            // Stop early once the bodies have stopped moving and the hard constraints are satisfied
+            residual = max(delta, error);
+            lastError = error;
+            if (adaptiveIterations && it + 1 >= minIterations && residual <= tolerance)
+                count = it + 1;
+
+            // Stop when the next iteration wouldn't fit in the time budget, keeping time for the post stabilization sweep.
+            // The velocity update below always follows the last iteration, so the step stays consistent however many were done.
+            if (timeBudget > 0)
+            {
+                auto now = std::chrono::steady_clock::now();
+                auto reserve = postStabilize ? primalTime : std::chrono::steady_clock::duration{};
+                if (now + (now - iterationStart) + reserve > deadline)
+                    count = it + 1;
             }
+        }
 
-            force = force->next;
+        // If we are are the final iteration before post stabilization, compute velocities (BDF1)
+        if (it == count - 1)
+        {
+            STATS_TIMER(local, time[PHASE_VELOCITY]);
+            if (island >= 0)
+            {
+                for (int k = islandOffsets[island]; k < islandOffsets[island + 1]; k++)
+                {
+                    int i = islandBodies[k];
+                    bodies.prevVelocity[i] = bodies.velocity[i];
+                    bodies.velocity[i] = (bodies.position[i] - bodies.initial[i]) / dt;
+                }
+            }
+            else
+            {
+                for (int i = 0; i < bodies.size(); i++)
+                {
+                    if (bodies.asleep[i])
+                        continue;
+                    bodies.prevVelocity[i] = bodies.velocity[i];
+                    if (bodies.mass[i] > 0)
+                        bodies.velocity[i] = (bodies.position[i] - bodies.initial[i]) / dt;
+                }
+            }
         }
     }
 
-    // Initialize and warmstart bodies (ie primal variables)
-    for (Rigid* body = bodies; body != 0; body = body->next)
+    STATS_MAX(local, iterations, count);
+    STATS_MAX(local, residual, residual);
+    STATS_MAX(local, error, lastError);
+}
+
+bool Solver::contactsChanged(int island)
+{
+    if (island < 0)
     {
-        // Don't let bodies rotate too fast
-        body->velocity.z = clamp(body->velocity.z, -50.0f, 50.0f);
+        ForcePool<Manifold>& manifolds = forcePool<Manifold>();
+        for (int i = 0; i < manifolds.size(); i++)
+            if (manifolds[i]->changed && !asleep(manifolds[i]))
+                return true;
+        return false;
+    }
 
-        // Compute inertial position (Eq 2)
-        body->inertial = body->position + body->velocity * dt;
-        if (body->mass > 0)
-            body->inertial += float3{ 0, gravity, 0 } * (dt * dt);
+    for (int k = islandForceOffsets[island]; k < islandForceOffsets[island + 1]; k++)
+    {
+        Force* force = islandForces[k];
+        if (force->type == ForceTypes::indexOf<Manifold>() && static_cast<Manifold*>(force)->changed)
+            return true;
+    }
+    return false;
+}
 
-        // Adaptive warmstart (See original VBD paper)
-        float3 accel = (body->velocity - body->prevVelocity) / dt;
-        float accelExt = accel.y * sign(gravity);
-        float accelWeight = clamp(accelExt / abs(gravity), 0.0f, 1.0f);
-        if (!isfinite(accelWeight)) accelWeight = 0.0f;
+void Solver::accelerate(int island, float omega, bool start)
+{
+    // x = omega * (x - x'') + x'', where x'' is the position from two iterations ago (see the VBD paper)
+    auto blend = [&](int i) {
+        float3 x = bodies.position[i];
+        if (start)
+            chebyshevPrev[i] = x;
+        else if (omega != 1.0f)
+        {
+            x = (x - chebyshevPrev2[i]) * omega + chebyshevPrev2[i];
+            bodies.position[i] = x;
+            bodies.rotation[i] = rotation(x.z);
+        }
+        chebyshevPrev2[i] = chebyshevPrev[i];
+        chebyshevPrev[i] = x;
+    };
 
-        // Save initial position (x-) and compute warmstarted position (See original VBD paper)
-        body->initial = body->position;
-        body->position = body->position + body->velocity * dt + float3{ 0, gravity, 0 } * (accelWeight * dt * dt);
+    if (island >= 0)
+    {
+        for (int k = islandOffsets[island]; k < islandOffsets[island + 1]; k++)
+            blend(islandBodies[k]);
+        return;
     }
 
-    // Main solver loop
-    // If using post stabilization, we'll use one extra iteration for the stabilization
-    int totalIterations = iterations + (postStabilize ? 1 : 0);
+    pool.parallelFor(bodies.size(), PRIMAL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            if (bodies.mass[i] > 0 && !bodies.asleep[i])
+                blend(i);
+    });
+}
 
-    for (int it = 0; it < totalIterations; it++)
-    {
-        // If using post stabilization, either remove all or none of the pre-existing constraint error
-        float currentAlpha = alpha;
-        if (postStabilize)
-            currentAlpha = it < iterations ? 1.0f : 0.0f;
+void Solver::buildIslands()
+{
+    // Islands are the awake dynamic bodies connected by forces. Static bodies don't join islands together.
+    int count = bodies.size();
+    islandParents.resize(count);
+    for (int i = 0; i < count; i++)
+        islandParents[i] = i;
 
-        // Primal update
-        for (Rigid* body = bodies; body != 0; body = body->next)
+    auto find = [&](int i) {
+        while (islandParents[i] != i)
         {
-            // Skip static / kinematic bodies
-            if (body->mass <= 0)
+            islandParents[i] = islandParents[islandParents[i]];
+            i = islandParents[i];
+        }
+        return i;
+    };
+
+    auto dynamic = [&](Rigid* body) { return body && bodies.mass[body->index()] > 0 && !bodies.asleep[body->index()]; };
+
+    forEachPool([&](auto& list) {
+        for (Force* force : list.forces)
+        {
+            if (!dynamic(force->bodyA) || !dynamic(force->bodyB))
                 continue;
 
-            // Initialize left and right hand sides of the linear system (Eqs. 5, 6)
-            float3x3 M = diagonal(body->mass, body->mass, body->moment);
-            float3x3 lhs = M / (dt * dt);
-            float3 rhs = M / (dt * dt) * (body->position - body->inertial);
+            // The lower index becomes the root, so the islands don't depend on the force order
+            int a = find(force->bodyA->index());
+            int b = find(force->bodyB->index());
+            if (a < b)
+                islandParents[b] = a;
+            else if (b < a)
+                islandParents[a] = b;
+        }
+    });
 
-            // Iterate over all forces acting on the body
-            for (Force* force = body->forces; force != 0; force = (force->bodyA == body) ? force->nextA : force->nextB)
-            {
-                // Compute constraint and its derivatives
-                force->computeConstraint(currentAlpha);
-                force->computeDerivatives(body);
+    // Number the islands in the order of their first body, and sort the bodies by island
+    islandIds.assign(count, -1);
+    islandCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (bodies.mass[i] <= 0 || bodies.asleep[i])
+            continue;
+        int root = find(i);
+        if (root == i)
+            islandIds[i] = islandCount++;
+        else
+            islandIds[i] = islandIds[root];
+    }
+    STATS_ADD(stats, islands, islandCount);
 
-                for (int i = 0; i < force->rows(); i++)
-                {
-                    // Use lambda as 0 if it's not a hard constraint
-                    float lambda = isinf(force->stiffness[i]) ? force->lambda[i] : 0.0f;
+    // The extra bucket for forces without an island has no bodies
+    islandOffsets.assign(islandCount + 2, 0);
+    for (int i = 0; i < count; i++)
+        if (islandIds[i] >= 0)
+            islandOffsets[islandIds[i] + 1]++;
+    for (int i = 0; i <= islandCount; i++)
+        islandOffsets[i + 1] += islandOffsets[i];
 
-                    // Compute the clamped force magnitude (Sec 3.2)
-                    float f = clamp(force->penalty[i] * force->C[i] + lambda, force->fmin[i], force->fmax[i]);
+    islandBodies.resize(islandOffsets[islandCount]);
+    std::vector<int>& next = islandParents;
+    next.assign(islandOffsets.begin(), islandOffsets.end() - 2);
+    for (int i = 0; i < count; i++)
+        if (islandIds[i] >= 0)
+            islandBodies[next[islandIds[i]]++] = i;
 
-                    // Compute the diagonally lumped geometric stiffness term (Sec 3.5)
-                    float3x3 G = diagonal(length(force->H[i].col(0)), length(force->H[i].col(1)), length(force->H[i].col(2))) * abs(f);
+    // Sort the awake forces by island. Forces which act on no dynamic body go in an extra bucket at the end.
+    auto islandOf = [&](Force* force) {
+        if (dynamic(force->bodyA))
+            return islandIds[force->bodyA->index()];
+        if (dynamic(force->bodyB))
+            return islandIds[force->bodyB->index()];
+        return islandCount;
+    };
 
-                    // Accumulate force (Eq. 13) and hessian (Eq. 17)
-                    rhs += force->J[i] * f;
-                    lhs += outer(force->J[i], force->J[i] * force->penalty[i]) + G;
-                }
-            }
+    islandForceOffsets.assign(islandCount + 2, 0);
+    forEachPool([&](auto& list) {
+        for (Force* force : list.forces)
+            if (!asleep(force))
+                islandForceOffsets[islandOf(force) + 1]++;
+    });
+    for (int i = 0; i <= islandCount; i++)
+        islandForceOffsets[i + 1] += islandForceOffsets[i];
+
+    islandForces.resize(islandForceOffsets[islandCount + 1]);
+    next.assign(islandForceOffsets.begin(), islandForceOffsets.end() - 1);
+    forEachPool([&](auto& list) {
+        for (Force* force : list.forces)
+            if (!asleep(force))
+                islandForces[next[islandOf(force)]++] = force;
+    });
+}
+
+void Solver::updateRotations()
+{
+    for (int i = 0; i < bodies.size(); i++)
+        if (!bodies.asleep[i])
+            bodies.rotation[i] = rotation(bodies.position[i].z);
+}
+
+void Solver::updateSleep()
+{
+    if (!enableSleep)
+    {
+        std::fill(bodies.asleep.begin(), bodies.asleep.end(), 0);
+        return;
+    }
 
-            // Solve the SPD linear system using LDL and apply the update (Eq. 4)
-            body->position -= solve(lhs, rhs);
+    for (int island = 0; island < islandCount; island++)
+    {
+        // Track how long each body has been resting, and the shortest time of the island
+        float sleepTime = INFINITY;
+        for (int k = islandOffsets[island]; k < islandOffsets[island + 1]; k++)
+        {
+            int i = islandBodies[k];
+            float3 v = bodies.velocity[i];
+            if (lengthSq(v.xy()) > SLEEP_LINEAR_VELOCITY * SLEEP_LINEAR_VELOCITY || abs(v.z) > SLEEP_ANGULAR_VELOCITY)
+                bodies.sleepTime[i] = 0;
+            else
+                bodies.sleepTime[i] += dt;
+            sleepTime = min(sleepTime, bodies.sleepTime[i]);
         }
 
-        // Dual update, only for non stabilized iterations in the case of post stabilization
-        // If doing more than one post stabilization iteration, we can still do a dual update,
-        // but make sure not to persist the penalty or lambda updates done during the stabilization iterations for the next frame.
-        if (it < iterations)
+        // Islands sleep as a whole, so a body never rests on a sleeping body while being awake itself
+        if (sleepTime < SLEEP_TIME)
+            continue;
+        for (int k = islandOffsets[island]; k < islandOffsets[island + 1]; k++)
         {
-            for (Force* force = forces; force != 0; force = force->next)
+            int i = islandBodies[k];
+            bodies.asleep[i] = 1;
+            bodies.velocity[i] = { 0, 0, 0 };
+            bodies.prevVelocity[i] = { 0, 0, 0 };
+        }
+    }
+}
+
+void Solver::wake(Rigid* body)
+{
+    if (!body)
+        return;
+
+    int index = body->index();
+    bodies.sleepTime[index] = 0;
+    if (!bodies.asleep[index])
+        return;
+
+    // Wake every sleeping body connected to this one, which is the island it fell asleep with
+    bodies.asleep[index] = 0;
+    wakeStack.push_back(body);
+    while (!wakeStack.empty())
+    {
+        Rigid* current = wakeStack.back();
+        wakeStack.pop_back();
+        for (Force* force = current->forces; force != 0; force = (force->bodyA == current) ? force->nextA : force->nextB)
+        {
+            Rigid* other = force->bodyA == current ? force->bodyB : force->bodyA;
+            if (!other)
+                continue;
+            int i = other->index();
+            if (bodies.asleep[i])
             {
-                // Compute constraint
-                force->computeConstraint(currentAlpha);
+                bodies.asleep[i] = 0;
+                bodies.sleepTime[i] = 0;
+                wakeStack.push_back(other);
+            }
+        }
+    }
+}
 
-                for (int i = 0; i < force->rows(); i++)
-                {
-                    // Use lambda as 0 if it's not a hard constraint
-                    float lambda = isinf(force->stiffness[i]) ? force->lambda[i] : 0.0f;
+// Interleaves the bits of two 16 bit coordinates
+static uint32_t morton(uint32_t x, uint32_t y)
+{
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    y = (y | (y << 8)) & 0x00FF00FF;
+    y = (y | (y << 4)) & 0x0F0F0F0F;
+    y = (y | (y << 2)) & 0x33333333;
+    y = (y | (y << 1)) & 0x55555555;
+    return x | (y << 1);
+}
+
+void Solver::reorder()
+{
+    int count = bodies.size();
+    if (count == 0)
+        return;
 
-                    // Update lambda (Eq 11)
-                    force->lambda[i] = clamp(force->penalty[i] * force->C[i] + lambda, force->fmin[i], force->fmax[i]);
+    // Quantize the positions to 16 bits within the bounds of all bodies
+    float2 lower = bodies.position[0].xy();
+    float2 upper = lower;
+    for (int i = 1; i < count; i++)
+    {
+        lower = float2{ min(lower.x, bodies.position[i].x), min(lower.y, bodies.position[i].y) };
+        upper = float2{ max(upper.x, bodies.position[i].x), max(upper.y, bodies.position[i].y) };
+    }
+    float2 extent = upper - lower;
+    float scale = 65535.0f / max(max(extent.x, extent.y), 1e-6f);
 
-                    // Disable the force if it has exceeded its fracture threshold
-                    if (fabsf(force->lambda[i]) >= force->fracture[i])
-                        force->disable();
+    // Sort by Morton code, using the index to break ties so the order is deterministic
+    std::vector<uint64_t> keys(count);
+    for (int i = 0; i < count; i++)
+    {
+        float2 p = (bodies.position[i].xy() - lower) * scale;
+        keys[i] = (uint64_t)morton((uint32_t)p.x, (uint32_t)p.y) << 32 | (uint32_t)i;
+    }
+    std::sort(keys.begin(), keys.end());
 
-                    // Update the penalty parameter and clamp to material stiffness if we are within the force bounds (Eq. 16)
-                    if (force->lambda[i] > force->fmin[i] && force->lambda[i] < force->fmax[i])
-                        force->penalty[i] = min(force->penalty[i] + beta * abs(force->C[i]), min(PENALTY_MAX, force->stiffness[i]));
-                }
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+        order[i] = (int)(keys[i] & 0xFFFFFFFF);
+    bodies.permute(order);
+
+    // Renumber the forces to follow their bodies, so the force loops also walk the bodies in order
+    forEachPool([&](auto& list) {
+        auto first = [](Force* force) {
+            int a = force->bodyA ? force->bodyA->index() : INT32_MAX;
+            int b = force->bodyB ? force->bodyB->index() : INT32_MAX;
+            return a < b ? a : b;
+        };
+        std::stable_sort(list.forces.begin(), list.forces.end(), [&](Force* a, Force* b) { return first(a) < first(b); });
+        for (int i = 0; i < list.size(); i++)
+            list.forces[i]->slot = i;
+    });
+}
+
+void Solver::buildAdjacency()
+{
+    // Compressed sparse rows of the forces of each body, so the iterations stream through memory instead of chasing list links
+    adjacency.clear();
+    adjacencyOffsets.resize(bodies.size() + 1);
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        Rigid* body = bodies.rigid[i];
+        adjacencyOffsets[i] = (int)adjacency.size();
+        if (bodies.asleep[i])
+            continue;
+        for (Force* force = body->forces; force != 0; force = (force->bodyA == body) ? force->nextA : force->nextB)
+            adjacency.push_back({ force, force->bodyA == body });
+    }
+    adjacencyOffsets[bodies.size()] = (int)adjacency.size();
+}
+
+void Solver::color()
+{
+    // Greedy graph coloring, so that no two bodies connected by a force share a color.
+    // Static bodies are never updated, so they are left uncolored and don't constrain their neighbors.
+    for (Rigid* body : bodies.rigid)
+        body->color = -1;
+
+    int numColors = 0;
+    int stamp = 0;
+    std::fill(colorStamps.begin(), colorStamps.end(), 0);
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        if (bodies.mass[i] <= 0 || bodies.asleep[i])
+            continue;
+
+        // Mark the colors of all colored neighbors
+        stamp++;
+        for (int k = adjacencyOffsets[i]; k < adjacencyOffsets[i + 1]; k++)
+        {
+            const ForceLink& link = adjacency[k];
+            Rigid* other = link.sideA ? link.force->bodyB : link.force->bodyA;
+            if (other && other->color >= 0)
+                colorStamps[other->color] = stamp;
+        }
+
+        // Take the lowest free color
+        int c = 0;
+        while (c < numColors && colorStamps[c] == stamp)
+            c++;
+        if (c == numColors)
+        {
+            numColors++;
+            if ((int)colorStamps.size() < numColors)
+                colorStamps.push_back(0);
+        }
+        bodies.rigid[i]->color = c;
+    }
+
+    // Counting sort of the dynamic bodies by color, keeping the body order within each color
+    colorOffsets.assign(numColors + 1, 0);
+    for (Rigid* body : bodies.rigid)
+        if (body->color >= 0)
+            colorOffsets[body->color + 1]++;
+    for (int c = 0; c < numColors; c++)
+        colorOffsets[c + 1] += colorOffsets[c];
+
+    coloredBodies.resize(colorOffsets[numColors]);
+    std::vector<int> next(colorOffsets.begin(), colorOffsets.end() - 1);
+    for (int i = 0; i < bodies.size(); i++)
+        if (bodies.rigid[i]->color >= 0)
+            coloredBodies[next[bodies.rigid[i]->color]++] = i;
+}
+
+template <typename Fn>
+int Solver::forEachRow(int index, float alpha, Fn&& fn)
+{
+    // Iterate over all forces acting on the body
+    Rigid* body = bodies.rigid[index];
+    int rows = 0;
+    for (int k = adjacencyOffsets[index]; k < adjacencyOffsets[index + 1]; k++)
+    {
+        ForceTypes::dispatch(adjacency[k].force, [&](auto* typed) {
+            using T = std::remove_pointer_t<decltype(typed)>;
+
+            // Compute constraint and its derivatives. Rows past hessianRows have a zero hessian, so it isn't stored.
+            float3 J[T::maxRows];
+            float3x3 H[T::hessianRows > 0 ? T::hessianRows : 1];
+            typed->computeConstraint(alpha);
+            typed->computeDerivatives(body, J, H);
+            rows += typed->rows();
+
+            for (int i = 0; i < typed->rows(); i++)
+            {
+                // Use lambda as 0 if it's not a hard constraint
+                float lambda = isinf(typed->stiffness[i]) ? typed->lambda[i] : 0.0f;
+
+                // Compute the clamped force magnitude (Sec 3.2)
+                float f = clamp(typed->penalty[i] * typed->C[i] + lambda, typed->fmin[i], typed->fmax[i]);
+
+                fn(J[i], typed->penalty[i], f, i < T::hessianRows ? &H[i] : (const float3x3*)0);
             }
+        });
+    }
+    return rows;
+}
+
+int Solver::primalUpdate(int index, float alpha, float& delta)
+{
+    // Initialize left and right hand sides of the linear system (Eqs. 5, 6)
+    float3x3 M = diagonal(bodies.mass[index], bodies.mass[index], bodies.moment[index]);
+    float3x3 lhs = M / (dt * dt);
+    float3 rhs = M / (dt * dt) * (bodies.position[index] - bodies.inertial[index]);
+
+    int rows = forEachRow(index, alpha, [&](const float3& J, float penalty, float f, const float3x3* H) {
+        // Accumulate force (Eq. 13)
+        rhs += J * f;
+
+        // Accumulate hessian (Eq. 17), including the diagonally lumped geometric stiffness term (Sec 3.5)
+        if (H)
+        {
+            float3x3 G = diagonal(length(H->col(0)), length(H->col(1)), length(H->col(2))) * abs(f);
+            lhs += outer(J, J * penalty) + G;
         }
+        else
+            lhs += outer(J, J * penalty);
+    });
 
-        // If we are are the final iteration before post stabilization, compute velocities (BDF1)
-        if (it == iterations - 1)
+    // Solve the SPD linear system using LDL and apply the update (Eq. 4)
+    float3 dx = solve(lhs, rhs);
+    bodies.position[index] -= dx;
+    bodies.rotation[index] = rotation(bodies.position[index].z);
+    delta = max(delta, max(max(fabsf(dx.x), fabsf(dx.y)), fabsf(dx.z)));
+    return rows;
+}
+
+// Constraint row of one body, kept for the batched primal update
+struct BatchRow
+{
+    float3 J;
+    float penalty;
+    float f;
+    float3 G;   // Diagonal of the lumped geometric stiffness (Sec 3.5), before scaling by |f|
+};
+
+int Solver::primalUpdateBatch(const int* indices, int count, float alpha, float& delta)
+{
+    // Same as primalUpdate, for up to SIMD_WIDTH bodies which share no forces. The constraints are evaluated one body at
+    // a time, and the hessian accumulation and solve are done for all the bodies at once, one per lane. The operations of
+    // each lane match the scalar path, so the results are the same.
+    thread_local std::vector<BatchRow> laneRows[SIMD_WIDTH];
+    alignas(32) float lhs[6][SIMD_WIDTH];
+    alignas(32) float rhs[3][SIMD_WIDTH];
+
+    int rows = 0;
+    int longest = 0;
+    for (int l = 0; l < SIMD_WIDTH; l++)
+    {
+        std::vector<BatchRow>& list = laneRows[l];
+        list.clear();
+
+        // Unused lanes solve an identity system
+        if (l >= count)
+        {
+            lhs[0][l] = 1; lhs[1][l] = 0; lhs[2][l] = 1; lhs[3][l] = 0; lhs[4][l] = 0; lhs[5][l] = 1;
+            rhs[0][l] = 0; rhs[1][l] = 0; rhs[2][l] = 0;
+            continue;
+        }
+
+        // Initialize left and right hand sides of the linear system (Eqs. 5, 6)
+        int index = indices[l];
+        float3x3 M = diagonal(bodies.mass[index], bodies.mass[index], bodies.moment[index]);
+        float3x3 A = M / (dt * dt);
+        float3 b = M / (dt * dt) * (bodies.position[index] - bodies.inertial[index]);
+        lhs[0][l] = A[0][0]; lhs[1][l] = A[1][0]; lhs[2][l] = A[1][1]; lhs[3][l] = A[2][0]; lhs[4][l] = A[2][1]; lhs[5][l] = A[2][2];
+        rhs[0][l] = b.x; rhs[1][l] = b.y; rhs[2][l] = b.z;
+
+        rows += forEachRow(index, alpha, [&](const float3& J, float penalty, float f, const float3x3* H) {
+            float3 G = H ? float3{ length(H->col(0)), length(H->col(1)), length(H->col(2)) } : float3{ 0, 0, 0 };
+            list.push_back({ J, penalty, f, G });
+        });
+        longest = (int)list.size() > longest ? (int)list.size() : longest;
+    }
+
+    sym3x3v a = { floatv::load(lhs[0]), floatv::load(lhs[1]), floatv::load(lhs[2]), floatv::load(lhs[3]), floatv::load(lhs[4]), floatv::load(lhs[5]) };
+    float3v b = { floatv::load(rhs[0]), floatv::load(rhs[1]), floatv::load(rhs[2]) };
+
+    // Accumulate row r of every body at once. Bodies with fewer rows are padded with zero rows, which add nothing.
+    alignas(32) float row[8][SIMD_WIDTH];
+    for (int r = 0; r < longest; r++)
+    {
+        for (int l = 0; l < SIMD_WIDTH; l++)
         {
-            for (Rigid* body = bodies; body != 0; body = body->next)
+            static const BatchRow zero = {};
+            const BatchRow& src = r < (int)laneRows[l].size() ? laneRows[l][r] : zero;
+            row[0][l] = src.J.x; row[1][l] = src.J.y; row[2][l] = src.J.z;
+            row[3][l] = src.penalty; row[4][l] = src.f;
+            row[5][l] = src.G.x; row[6][l] = src.G.y; row[7][l] = src.G.z;
+        }
+
+        floatv Jx = floatv::load(row[0]), Jy = floatv::load(row[1]), Jz = floatv::load(row[2]);
+        floatv penalty = floatv::load(row[3]), f = floatv::load(row[4]);
+        floatv af = abs(f);
+
+        // Accumulate force (Eq. 13)
+        b.x += Jx * f;
+        b.y += Jy * f;
+        b.z += Jz * f;
+
+        // Accumulate hessian (Eq. 17), including the diagonally lumped geometric stiffness term (Sec 3.5)
+        floatv Px = Jx * penalty, Py = Jy * penalty, Pz = Jz * penalty;
+        a.a00 += Jx * Px + floatv::load(row[5]) * af;
+        a.a10 += Jy * Px;
+        a.a11 += Jy * Py + floatv::load(row[6]) * af;
+        a.a20 += Jz * Px;
+        a.a21 += Jz * Py;
+        a.a22 += Jz * Pz + floatv::load(row[7]) * af;
+    }
+
+    // Solve the SPD linear systems using LDL and apply the updates (Eq. 4)
+    float3v x = solve(a, b);
+    x.x.store(rhs[0]);
+    x.y.store(rhs[1]);
+    x.z.store(rhs[2]);
+    for (int l = 0; l < count; l++)
+    {
+        bodies.position[indices[l]] -= float3{ rhs[0][l], rhs[1][l], rhs[2][l] };
+        bodies.rotation[indices[l]] = rotation(bodies.position[indices[l]].z);
+        delta = max(delta, max(max(fabsf(rhs[0][l]), fabsf(rhs[1][l])), fabsf(rhs[2][l])));
+    }
+    return rows;
+}
+
+template <typename T>
+void Solver::initialize(ForcePool<T>& list)
+{
+    // Each force only touches its own state, so forces are initialized in parallel. Inactive forces are
+    // only marked here, and destroyed by the serial compact() afterwards (which sorts the dead slots).
+    std::atomic<int> destroyed(0);
+    pool.parallelFor(list.size(), FORCE_GRAIN, [&](int begin, int end) {
+        int dead[FORCE_GRAIN];
+        int numDead = 0;
+        auto flush = [&]() {
+            std::lock_guard<std::mutex> lock(deadMutex);
+            list.dead.insert(list.dead.end(), dead, dead + numDead);
+            destroyed += numDead;
+            numDead = 0;
+        };
+
+        // Initialization can including caching anything that is constant over the step.
+        // Manifolds are done in batches, so their narrowphase can test several pairs at once.
+        T* batch[SIMD_WIDTH];
+        int slots[SIMD_WIDTH];
+        int count = 0;
+        auto run = [&]() {
+            // The whole range is passed at once when running on a single thread
+            if (numDead + count > FORCE_GRAIN)
+                flush();
+
+            bool active[SIMD_WIDTH];
+            if constexpr (std::is_same<T, Manifold>::value)
+                Manifold::initializeBatch(batch, count, active);
+            else
             {
-                body->prevVelocity = body->velocity;
-                if (body->mass > 0)
-                    body->velocity = (body->position - body->initial) / dt;
+                for (int i = 0; i < count; i++)
+                    active[i] = batch[i]->initialize();
             }
+
+            // Force has returned false meaning it is inactive, so mark it for removal from the solver
+            for (int i = 0; i < count; i++)
+                if (!active[i])
+                    dead[numDead++] = slots[i];
+            count = 0;
+        };
+
+        for (int i = begin; i < end; i++)
+        {
+            // Sleeping forces are left as they are until their island wakes up
+            if (asleep(list.forces[i]))
+                continue;
+            batch[count] = list[i];
+            slots[count++] = i;
+            if (count == SIMD_WIDTH)
+                run();
         }
+        if (count > 0)
+            run();
+
+        if (numDead > 0)
+            flush();
+    });
+    STATS_ADD(stats, manifoldsDestroyed, (std::is_same<T, Manifold>::value ? destroyed.load() : 0));
+}
+
+template <typename T>
+void Solver::warmstart(T* force)
+{
+    for (int i = 0; i < force->rows(); i++)
+    {
+        if (postStabilize)
+        {
+            // With post stabilization, we can reuse the full lambda from the previous step,
+            // and only need to reduce the penalty parameters
+            force->penalty[i] = clamp(force->penalty[i] * gamma, PENALTY_MIN, PENALTY_MAX);
+        }
+        else
+        {
+            // Warmstart the dual variables and penalty parameters (Eq. 19)
+            // Penalty is safely clamped to a minimum and maximum value
+            force->lambda[i] = force->lambda[i] * alpha * gamma;
+            force->penalty[i] = clamp(force->penalty[i] * gamma, PENALTY_MIN, PENALTY_MAX);
+        }
+
+        // If it's not a hard constraint, we don't let the penalty exceed the material stiffness
+        force->penalty[i] = min(force->penalty[i], force->stiffness[i]);
+    }
+}
+
+template <typename T>
+bool Solver::dualUpdate(T* force, float alpha, float& error)
+{
+    // Compute constraint
+    force->computeConstraint(alpha);
+
+    bool fracture = false;
+    for (int i = 0; i < force->rows(); i++)
+    {
+        // Use lambda as 0 if it's not a hard constraint
+        float lambda = isinf(force->stiffness[i]) ? force->lambda[i] : 0.0f;
+
+        // Update lambda (Eq 11)
+        force->lambda[i] = clamp(force->penalty[i] * force->C[i] + lambda, force->fmin[i], force->fmax[i]);
+
+        // The force should be disabled if it has exceeded its fracture threshold
+        if (fabsf(force->lambda[i]) >= force->fracture[i])
+            fracture = true;
+
+        // Update the penalty parameter and clamp to material stiffness if we are within the force bounds (Eq. 16)
+        if (force->lambda[i] > force->fmin[i] && force->lambda[i] < force->fmax[i])
+            force->penalty[i] = min(force->penalty[i] + beta * abs(force->C[i]), min(PENALTY_MAX, force->stiffness[i]));
+
+        // Hard rows are violated unless the force is at a bound and the error pulls further past it (eg separating contacts)
+        bool inactive = (force->lambda[i] >= force->fmax[i] && force->C[i] > 0) || (force->lambda[i] <= force->fmin[i] && force->C[i] < 0);
+        if (isinf(force->stiffness[i]) && !inactive)
+            error = max(error, fabsf(force->C[i]));
     }
+    return fracture;
 }
 
-void Solver::draw()
+template <typename T>
+void Solver::dualUpdate(ForcePool<T>& list, float alpha, float& error)
 {
-    for (Rigid* body = bodies; body != 0; body = body->next)
-        body->draw();
-    for (Force* force = forces; force != 0; force = force->next)
-        force->draw();
+    // Each force only updates its own rows, so forces are updated in parallel. Fractured forces are
+    // collected and disabled afterwards in pool order, so the result doesn't depend on scheduling.
+    std::atomic<int> rows(0);
+    std::atomic<float> largest(error);
+    pool.parallelFor(list.size(), FORCE_GRAIN, [&](int begin, int end) {
+        int r = 0;
+        float e = 0.0f;
+        for (int f = begin; f < end; f++)
+        {
+            T* force = list[f];
+            if (asleep(force))
+                continue;
+
+            r += force->rows();
+            if (dualUpdate(force, alpha, e))
+            {
+                std::lock_guard<std::mutex> lock(fractureMutex);
+                fractured.push_back(f);
+            }
+        }
+        rows += r;
+        atomicMax(largest, e);
+    });
+    error = largest.load();
+    STATS_ADD(stats, dualRows, rows.load());
+
+    if (!fractured.empty())
+    {
+        std::sort(fractured.begin(), fractured.end());
+        for (int f : fractured)
+        {
+            // Breaking a force changes how its bodies are held, so they shouldn't fall asleep straight away
+            list[f]->disable();
+            wake(list.forces[f]->bodyA);
+            wake(list.forces[f]->bodyB);
+        }
+        fractured.clear();
+    }
 }
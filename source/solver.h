@@ -11,90 +11,167 @@
 
 #pragma once
 
-#ifdef _WIN32
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <windows.h>
-#endif
-
-#ifdef TARGET_OS_MAC
-#include <OpenGL/GL.h>
-#else
-#include <GL/gl.h>
-#endif
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <memory>
+#include <chrono>
+#include <new>
 
 #include "maths.h"
+#include "stats.h"
+#include "aabbtree.h"
+#include "threads.h"
 
 #define MAX_ROWS 4                    // Most number of rows an individual constraint can have
 #define PENALTY_MIN 1.0f              // Minimum penalty parameter
 #define PENALTY_MAX 1000000000.0f     // Maximum penalty parameter
 #define COLLISION_MARGIN 0.0005f      // Margin for collision detection to avoid flickering contacts
 #define STICK_THRESH 0.01f            // Position threshold for sticking contacts (ie static friction)
-#define SHOW_CONTACTS true            // Whether to show contacts in the debug draw
+#define BROADPHASE_MARGIN 0.001f      // Padding of broadphase bounds, so float rounding can never cull a touching pair
+#define PRIMAL_GRAIN 16               // Number of bodies per task in the parallel primal update
+#define FORCE_GRAIN 64                // Number of forces per task in the parallel force loops
+#define FORCE_BLOCK_SIZE 256          // Number of forces allocated at once by a ForceAllocator
+#define SLEEP_LINEAR_VELOCITY 0.05f   // Speed below which a body counts as resting
+#define SLEEP_ANGULAR_VELOCITY 0.05f  // Angular speed below which a body counts as resting
+#define SLEEP_TIME 0.5f               // Time all the bodies of an island must rest before it is put to sleep
+#define ISLAND_SPLIT 4                // Islands are solved in parallel when none holds more than 1 / ISLAND_SPLIT of the awake bodies
+#define CHEBYSHEV_START 2             // Iterations before the Chebyshev acceleration starts
 
 struct Rigid;
 struct Force;
 struct Manifold;
 struct Solver;
 
-// Holds all the state for a single rigid body that is needed by AVBD
+// Structure of arrays storage of the per-body state used by the solver loops. Bodies are packed densely,
+// so the loops stream through memory, and are addressed by stable handles which map to their current index.
+struct BodyStore
+{
+    std::vector<float3> position;
+    std::vector<float3> initial;
+    std::vector<float3> inertial;
+    std::vector<float3> velocity;
+    std::vector<float3> prevVelocity;
+    std::vector<float> mass;
+    std::vector<float> moment;
+    std::vector<float2x2> rotation; // Rotation matrix of each position's angle, refreshed by the solver whenever it moves the body
+    std::vector<float> sleepTime;   // Time the body has been resting
+    std::vector<uint8_t> asleep;    // Whether the body is part of a sleeping island, which the solver skips
+
+    std::vector<Rigid*> rigid;      // Body at each index
+    std::vector<int> handles;       // Handle of the body at each index
+    std::vector<int> slots;         // Index of each handle, or the next free handle if it is unused
+    int freeSlot;
+
+    BodyStore();
+
+    int size() const { return (int)rigid.size(); }
+    int index(int handle) const { return slots[handle]; }
+
+    // Both are O(1). Removal moves the last body into the freed index, but handles stay valid.
+    int create(Rigid* body);
+    void remove(int handle);
+
+    // Reorders the bodies, so that index i holds the body which was at index order[i]. Handles stay valid.
+    void permute(const std::vector<int>& order);
+};
+
+// Holds all the state for a single rigid body that is needed by AVBD. The state touched every iteration
+// lives in the solver's BodyStore, and is accessed through the handle.
 struct Rigid
 {
     Solver* solver;
     Force* forces;
-    Rigid* next;
-    float3 position;
-    float3 initial;
-    float3 inertial;
-    float3 velocity;
-    float3 prevVelocity;
+    int handle;
     float2 size;
-    float mass;
-    float moment;
     float friction;
     float radius;
+    int proxy;
+    int color;
+
+    uint32_t category;              // Collision category bits of this body
+    uint32_t mask;                  // Categories this body collides with
+    std::vector<Rigid*> ignored;    // Bodies this body never collides with (see Solver::ignoreCollision)
 
     Rigid(Solver* solver, float2 size, float density, float friction, float3 position, float3 velocity = float3{ 0, 0, 0 });
     ~Rigid();
 
+    int index() const;
+    float3& position() const;
+    float3& initial() const;
+    float3& inertial() const;
+    float3& velocity() const;
+    float3& prevVelocity() const;
+    float& mass() const;
+    float& moment() const;
+    float2x2& rotation() const;
+
+    // Same as the transform() and rotate() functions, using the cached rotation of the body
+    float2 transform(float2 v) const { return rotation() * v + position().xy(); }
+    float2 rotate(float2 v) const { return rotation() * v; }
+
     bool constrainedTo(Rigid* other) const;
-    void draw();
+    bool collidesWith(Rigid* other) const;
 };
 
-// Holds all user defined and derived constraint parameters, and provides a common interface for all forces.
+// Holds all user defined and derived constraint parameters which are common to all forces.
+// Force types don't derive from this directly, but from TypedForce (see below).
 struct Force
 {
     Solver* solver;
     Rigid* bodyA;
     Rigid* bodyB;
-    Force* nextA;
+    Force* nextA;   // Doubly linked lists of the forces of each body, so removal is O(1)
     Force* nextB;
-    Force* next;
-
-    float3 J[MAX_ROWS];
-    float3x3 H[MAX_ROWS];
-    float C[MAX_ROWS];
-    float fmin[MAX_ROWS];
-    float fmax[MAX_ROWS];
-    float stiffness[MAX_ROWS];
-    float fracture[MAX_ROWS];
-    float penalty[MAX_ROWS];
-    float lambda[MAX_ROWS];
-
-    Force(Solver* solver, Rigid* bodyA, Rigid* bodyB);
+    Force* prevA;
+    Force* prevB;
+    int type;       // Index of the force type in ForceTypes
+    int slot;       // Index of the force in the pool of its type
+
+    Force(Solver* solver, Rigid* bodyA, Rigid* bodyB, int type);
     virtual ~Force();
+};
 
-    void disable();
+// Base of every force type, which adds the force to the solver pool of its type, and holds its constraint rows.
+// Rows is the most rows the type can use, and only the first HessianRows rows can have a non zero hessian.
+// The solver loops are instantiated for each type, so the functions every type provides are called without virtual dispatch:
+//   int rows() const;                                          Number of constraint rows in use
+//   bool initialize();                                         Caches anything constant over the step. Returning false removes the force.
+//   void computeConstraint(float alpha);                       Computes C
+//   void computeDerivatives(Rigid* body, float3* J, float3x3* H);  Computes J (and H) of each row with respect to the given body
+template <typename T, int Rows, int HessianRows = 0>
+struct TypedForce : Force
+{
+    static_assert(Rows <= MAX_ROWS && HessianRows <= Rows, "Invalid row counts");
+
+    static constexpr int maxRows = Rows;
+    static constexpr int hessianRows = HessianRows;
+
+    // Whether forces of this type are created and destroyed by the solver itself, through ForcePool::create and destroy
+    static constexpr bool pooled = false;
+
+    float C[Rows];
+    float fmin[Rows];
+    float fmax[Rows];
+    float stiffness[Rows];
+    float fracture[Rows];
+    float penalty[Rows];
+    float lambda[Rows];
+
+    TypedForce(Solver* solver, Rigid* bodyA, Rigid* bodyB);
+    ~TypedForce();
 
-    virtual int rows() const = 0;
-    virtual bool initialize() = 0;
-    virtual void computeConstraint(float alpha) = 0;
-    virtual void computeDerivatives(Rigid* body) = 0;
-    virtual void draw() const {}
+    void disable();
 };
 
 // Revolute joint + angle constraint between two rigid bodies, with optional fracture
-struct Joint : Force
+struct Joint : TypedForce<Joint, 3, 2>
 {
     float2 rA, rB;
     float3 C0;
@@ -104,61 +181,44 @@ struct Joint : Force
     Joint(Solver* solver, Rigid* bodyA, Rigid* bodyB, float2 rA, float2 rB, float3 stiffness = float3{ INFINITY, INFINITY, INFINITY },
         float fracture = INFINITY);
 
-    int rows() const override { return 3; }
+    int rows() const { return 3; }
 
-    bool initialize() override;
-    void computeConstraint(float alpha) override;
-    void computeDerivatives(Rigid* body) override;
-    void draw() const override;
+    bool initialize();
+    void computeConstraint(float alpha);
+    void computeDerivatives(Rigid* body, float3* J, float3x3* H);
 };
 
 // Standard spring force
-struct Spring : Force
+struct Spring : TypedForce<Spring, 1, 1>
 {
     float2 rA, rB;
     float rest;
 
     Spring(Solver* solver, Rigid* bodyA, Rigid* bodyB, float2 rA, float2 rB, float stiffness, float rest = -1);
 
-    int rows() const override { return 1; }
+    int rows() const { return 1; }
 
-    bool initialize() override { return true; }
-    void computeConstraint(float alpha) override;
-    void computeDerivatives(Rigid* body) override;
-    void draw() const override;
-};
-
-// Force which has no physical effect, but is used to ignore collisions between two bodies
-struct IgnoreCollision : Force
-{
-    IgnoreCollision(Solver* solver, Rigid* bodyA, Rigid* bodyB)
-        : Force(solver, bodyA, bodyB) {}
-
-    int rows() const override { return 0; }
-
-    bool initialize() override { return true; }
-    void computeConstraint(float alpha) override {}
-    void computeDerivatives(Rigid* body) override {}
-    void draw() const override {}
+    bool initialize() { return true; }
+    void computeConstraint(float alpha);
+    void computeDerivatives(Rigid* body, float3* J, float3x3* H);
 };
 
 // Motor force which applies a torque to two rigid bodies to achieve a desired angular speed
-struct Motor : Force
+struct Motor : TypedForce<Motor, 1>
 {
     float speed;
 
     Motor(Solver* solver, Rigid* bodyA, Rigid* bodyB, float speed, float maxTorque);
 
-    int rows() const override { return 1; }
+    int rows() const { return 1; }
 
-    bool initialize() override { return true; }
-    void computeConstraint(float alpha) override;
-    void computeDerivatives(Rigid* body) override;
-    void draw() const override {}
+    bool initialize() { return true; }
+    void computeConstraint(float alpha);
+    void computeDerivatives(Rigid* body, float3* J, float3x3* H);
 };
 
 // Collision manifold between two rigid bodies, which contains up to two frictional contact points
-struct Manifold : Force
+struct Manifold : TypedForce<Manifold, 4>
 {
     // Used to track contact features between frames
     union FeaturePair
@@ -181,25 +241,255 @@ struct Manifold : Force
         float2 rB;
         float2 normal;
 
-        float3 JAn, JBn, JAt, JBt;
+        float2 JA, JB;  // Angular parts of the normal (x) and tangent (y) jacobians. The linear parts are +-normal and +-tangent.
         float2 C0;
         bool stick;
     };
 
+    static constexpr bool pooled = true;
+
     Contact contacts[2];
     int numContacts;
+    int separatedFrames;    // Number of steps in a row without contacts
+    bool changed;           // Whether the last initialize gained, lost or replaced contacts
     float friction;
 
     Manifold(Solver* solver, Rigid* bodyA, Rigid* bodyB);
 
-    int rows() const override { return numContacts * 2; }
+    int rows() const { return numContacts * 2; }
 
-    bool initialize() override;
-    void computeConstraint(float alpha) override;
-    void computeDerivatives(Rigid* body) override;
-    void draw() const override;
+    bool initialize();
+    void computeConstraint(float alpha);
+    void computeDerivatives(Rigid* body, float3* J, float3x3* H);
+
+    // Replaces the contacts with the given ones from the narrowphase, keeping the state of matching features
+    bool update(const Contact* found, int count);
+
+    // Initializes up to SIMD_WIDTH manifolds, running the separating axis tests of their narrowphase together
+    static void initializeBatch(Manifold* const* manifolds, int count, bool* active);
 
     static int collide(Rigid* bodyA, Rigid* bodyB, Contact* contacts);
+    static void collideBatch(Manifold* const* manifolds, int count, Contact (*contacts)[2], int* numContacts);
+
+    // Expands the compact jacobians of a contact
+    static void jacobians(const Contact& contact, float3& JAn, float3& JBn, float3& JAt, float3& JBt);
+};
+
+// List of all force types, which is the only place a new force type needs to be registered
+template <typename... Types>
+struct ForceTypeList
+{
+    static constexpr int count = sizeof...(Types);
+
+    template <typename T>
+    static constexpr int indexOf()
+    {
+        int index = 0, result = -1;
+        ((std::is_same<T, Types>::value ? result = index : 0, index++), ...);
+        return result;
+    }
+
+    // Calls fn(T*) with the force cast to its actual type
+    template <typename Fn>
+    static void dispatch(Force* force, Fn&& fn)
+    {
+        int index = 0;
+        (void)((force->type == index++ ? (fn(static_cast<Types*>(force)), true) : false) || ...);
+    }
+};
+
+using ForceTypes = ForceTypeList<Joint, Spring, Motor, Manifold>;
+
+// Recycles the memory of forces through a free list, so creating and destroying them doesn't go to the heap
+template <typename T>
+struct ForceAllocator
+{
+    struct alignas(T) Slot
+    {
+        unsigned char bytes[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> blocks;
+    std::vector<void*> freeSlots;
+
+    void* allocate()
+    {
+        if (freeSlots.empty())
+        {
+            // Push in reverse, so that the block is handed out in address order
+            blocks.emplace_back(new Slot[FORCE_BLOCK_SIZE]);
+            for (int i = FORCE_BLOCK_SIZE - 1; i >= 0; i--)
+                freeSlots.push_back(&blocks.back()[i]);
+        }
+
+        void* slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    void release(void* slot)
+    {
+        freeSlots.push_back(slot);
+    }
+};
+
+// Contiguous array of all the forces of one type in the solver. Removal moves the last force into the freed slot.
+template <typename T>
+struct ForcePool
+{
+    std::vector<Force*> forces;     // Held as the base type, since forces are added by the base constructor, before T is constructed
+    std::vector<int> dead;          // Slots of the forces to destroy in the next compact()
+    ForceAllocator<T> allocator;    // Only used by pooled types
+
+    int size() const { return (int)forces.size(); }
+    T* operator[](int slot) const { return static_cast<T*>(forces[slot]); }
+
+    void add(Force* force)
+    {
+        force->slot = size();
+        forces.push_back(force);
+    }
+
+    void remove(Force* force)
+    {
+        forces[force->slot] = forces.back();
+        forces[force->slot]->slot = force->slot;
+        forces.pop_back();
+    }
+
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(T::pooled, "Only pooled force types are created by the solver");
+        return new (allocator.allocate()) T(std::forward<Args>(args)...);
+    }
+
+    // Destroys a force the solver no longer needs, which was created with new, or with create for pooled types
+    void destroy(T* force)
+    {
+        if constexpr (T::pooled)
+        {
+            force->~T();
+            allocator.release(force);
+        }
+        else
+            delete force;
+    }
+
+    // Destroys all the dead forces at once. Going from the highest slot down, the force moved into a freed slot is always live.
+    void compact()
+    {
+        std::sort(dead.begin(), dead.end(), std::greater<int>());
+        for (int slot : dead)
+            destroy((*this)[slot]);
+        dead.clear();
+    }
+};
+
+template <typename T>
+struct ForcePoolsOf;
+
+template <typename... Types>
+struct ForcePoolsOf<ForceTypeList<Types...>>
+{
+    using type = std::tuple<ForcePool<Types>...>;
+};
+
+// Counts the forces acting between each pair of bodies, so checking if two bodies are constrained is O(1)
+struct PairTable
+{
+    struct Key
+    {
+        const Rigid* bodyA;
+        const Rigid* bodyB;
+
+        bool operator==(const Key& other) const { return bodyA == other.bodyA && bodyB == other.bodyB; }
+    };
+
+    struct Hash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t a = std::hash<const Rigid*>()(key.bodyA);
+            size_t b = std::hash<const Rigid*>()(key.bodyB);
+            return a ^ (b + 0x9e3779b9 + (a << 6) + (a >> 2));
+        }
+    };
+
+    std::unordered_map<Key, int, Hash> counts;
+
+    // Pairs are unordered, so the key always has the lower address first
+    static Key key(const Rigid* a, const Rigid* b) { return a < b ? Key{ a, b } : Key{ b, a }; }
+
+    void add(const Rigid* a, const Rigid* b);
+    void remove(const Rigid* a, const Rigid* b);
+    bool contains(const Rigid* a, const Rigid* b) const { return counts.count(key(a, b)) != 0; }
+};
+
+// Persistent broadphase. By default, body bounds are kept sorted along the x axis across steps, so that temporal
+// coherence makes the insertion sort close to linear, and the sweep only visits pairs overlapping on x.
+// Bodies are also kept in a dynamic AABB tree, which can be used instead of the sweep, and serves spatial queries.
+struct Broadphase
+{
+    struct Proxy
+    {
+        Rigid* body;
+        float minX, maxX;
+        float minY, maxY;
+        int rank;
+        int leaf;
+        bool asleep;    // The body is part of a sleeping island
+        bool awake;     // The body is dynamic and not asleep
+    };
+
+    struct Pair
+    {
+        Rigid* bodyA;
+        Rigid* bodyB;
+        int rankA, rankB;
+    };
+
+    std::vector<Proxy> proxies;     // Indexed by Rigid::proxy
+    std::vector<int> freeProxies;   // Proxies available for reuse
+    std::vector<int> order;         // Live proxies sorted by minX
+    std::vector<int> added;         // Proxies created since the last update
+    std::vector<int> removed;       // Proxies removed since the last update, which may still be in the order
+
+    AABBTree tree;                  // Tree of the body bounding boxes
+    bool treeDirty;                 // Whether bodies may have moved since the tree was last refit
+    bool useTree;                   // Whether to find pairs by querying the tree instead of sort and sweep
+
+    // Overlapping body pairs without a force between them, in the same order as a naive nested loop over the body store
+    std::vector<Pair> pairs;
+
+    Broadphase();
+
+    void add(Rigid* body);
+    void remove(Rigid* body);
+    void refit(const BodyStore& bodies);
+    void update(const BodyStore& bodies, StepStats& stats);
+
+    static AABB bounds(Rigid* body);
+
+    void sweep(StepStats& stats);
+    void queryTree(const BodyStore& bodies, StepStats& stats);
+    void testPair(const Proxy& a, const Proxy& b, StepStats& stats);
+};
+
+// Entry of the per-step body to force adjacency
+struct ForceLink
+{
+    Force* force;
+    bool sideA;     // Whether the body is bodyA of the force
+};
+
+// Result of a raycast against the bodies in the solver
+struct RayHit
+{
+    Rigid* body;        // Closest body hit, or null if nothing was hit
+    float2 point;       // World space hit point
+    float2 normal;      // World space surface normal at the hit point
+    float fraction;     // Fraction along the ray of the hit point
 };
 
 // Core solver class which holds all the rigid bodies and forces, and has logic to step the simulation forward in time
@@ -207,7 +497,16 @@ struct Solver
 {
     float dt;           // Timestep
     float gravity;      // Gravity
-    int iterations;     // Solver iterations
+    int iterations;     // Solver iterations (the most taken when iterating adaptively)
+
+    bool adaptiveIterations;    // Whether to stop iterating once the residual is below the tolerance
+    int minIterations;          // Fewest iterations taken when iterating adaptively
+    float tolerance;            // Residual (largest position update or hard constraint error) to stop iterating at
+
+    bool chebyshev;         // Whether to accelerate the primal iterations with Chebyshev semi-iteration
+    float spectralRadius;   // Estimated spectral radius of the iterations, which sets the Chebyshev weights
+
+    float timeBudget;       // Wall clock time (in milliseconds) a step may take, or zero for no limit
 
     float alpha;        // Stabilization parameter
     float beta;         // Penalty ramping parameter
@@ -215,15 +514,166 @@ struct Solver
 
     bool postStabilize; // Whether to apply post-stabilization to the system
 
-    Rigid* bodies;
-    Force* forces;
+    int keepAlive;      // Number of steps a manifold is kept after its bodies separate, so near contacts aren't recreated every step
+
+    int reorderInterval;    // Steps between sorting the bodies along a Morton curve, so nearby bodies are nearby in memory (0 disables)
+    int stepIndex;          // Number of steps taken
+
+    int threads;        // Number of threads used by the solver (more than one solves islands in parallel, or uses graph coloring for the primal update)
+
+    bool enableSleep;   // Whether islands of resting bodies are put to sleep
+
+    BodyStore bodies;
+    ForcePoolsOf<ForceTypes>::type forces;  // One pool per force type
+
+    PairTable pairs;
+    PairTable ignoredPairs;
+    Broadphase broadphase;
+
+    ThreadPool pool;
+    std::vector<int> fractured;         // Indices of the forces in a pool which fractured in a dual update
+    std::vector<ForceLink> adjacency;   // Forces of each body, in the order of the body force lists
+    std::vector<int> adjacencyOffsets;  // Start of the forces of each body index in adjacency, plus the end
+    std::mutex fractureMutex;
+    std::mutex deadMutex;               // Guards the dead lists of the pools during the parallel initialize
+    std::vector<int> islandParents;     // Union-find forest of the awake bodies connected by forces
+    std::vector<int> islandIds;         // Island of each body index, or -1 for static and sleeping bodies
+    std::vector<int> islandBodies;      // Indices of the awake dynamic bodies sorted by island, in body order within each island
+    std::vector<int> islandOffsets;     // Start of each island in islandBodies, plus the empty extra bucket and the end
+    std::vector<Force*> islandForces;   // Awake forces sorted by island, in pool order within each island
+    std::vector<int> islandForceOffsets; // Start of each island in islandForces, plus the forces acting on no dynamic body, plus the end
+    std::vector<int> islandTasks;       // Islands ordered from the largest to the smallest, for the island parallel solve
+    std::vector<Force*> broken;         // Forces which fractured in the island parallel solve
+    int islandCount;
+    bool colored;                       // Whether the primal update of this step uses the graph coloring
+    std::chrono::steady_clock::time_point deadline; // End of the time budget of this step
+    std::vector<Rigid*> wakeStack;      // Scratch used to wake whole islands
+    std::vector<float3> chebyshevPrev;  // Positions of each body after the previous iteration, for the Chebyshev acceleration
+    std::vector<float3> chebyshevPrev2; // Positions of each body from two iterations ago
+    std::vector<int> coloredBodies;     // Indices of the dynamic bodies sorted by color
+    std::vector<int> colorOffsets;      // Start of each color in coloredBodies, plus the end
+    std::vector<int> colorStamps;       // Scratch used to find free colors
+
+    StepStats stats;    // Instrumentation of the last step
 
     Solver();
     ~Solver();
 
     Rigid* pick(float2 at, float2& local);
+    void queryPoint(float2 point, std::vector<Rigid*>& results);
+    void queryAABB(const AABB& box, std::vector<Rigid*>& results);
+    void raycast(const float2* from, const float2* to, RayHit* hits, int count);
+    void ignoreCollision(Rigid* bodyA, Rigid* bodyB);
+
+    template <typename T>
+    ForcePool<T>& forcePool() { return std::get<ForcePool<T>>(forces); }
+
+    // Calls fn(ForcePool<T>&) for the pool of each force type
+    template <typename Fn>
+    void forEachPool(Fn&& fn) { std::apply([&](auto&... pools) { (fn(pools), ...); }, forces); }
+
+    int forceCount();
+
+    // Destroys a force of any type, which is O(1)
+    void destroy(Force* force);
     void clear();
     void defaultParams();
     void step();
-    void draw();
+    void updateRotations();
+    void updateSleep();
+    void buildIslands();
+
+    // Runs the solver iterations over all awake bodies, or over the bodies and forces of one island (see buildIslands).
+    // Counters are added to the given stats, which are local to the task when islands are solved in parallel.
+    void solveIsland(int island, StepStats& local);
+
+    // Whether any manifold of the island (or of the world, for -1) gained, lost or replaced contacts this step
+    bool contactsChanged(int island);
+
+    // Chebyshev acceleration of the positions of the island (or all awake bodies, for -1). Blends each position with the one
+    // from two iterations ago by omega, or only records the positions when starting a new sequence.
+    void accelerate(int island, float omega, bool start);
+
+    // Wakes the island of a body (if it is asleep), and restarts its resting time
+    void wake(Rigid* body);
+
+    // Whether a force belongs to a sleeping island. Forces never connect an awake body to a sleeping one.
+    bool asleep(const Force* force) const;
+    void reorder();
+    void buildAdjacency();
+    void color();
+
+    // Solves the body systems, and raises delta to the largest component of the position updates
+    int primalUpdate(int index, float alpha, float& delta);
+    int primalUpdateBatch(const int* indices, int count, float alpha, float& delta);
+
+    // Calls fn(J, penalty, f, H) for each constraint row acting on a body, where H is null for rows without a hessian
+    template <typename Fn>
+    int forEachRow(int index, float alpha, Fn&& fn);
+
+    // Instantiated for each force type in solver.cpp
+    template <typename T>
+    void initialize(ForcePool<T>& list);
+    template <typename T>
+    void warmstart(T* force);
+    template <typename T>
+    void dualUpdate(ForcePool<T>& list, float alpha, float& error);
+
+    // Updates the dual variables of one force, and returns whether it exceeded its fracture threshold.
+    // Raises error to the largest violation of its hard rows.
+    template <typename T>
+    bool dualUpdate(T* force, float alpha, float& error);
 };
+
+inline int Rigid::index() const { return solver->bodies.index(handle); }
+inline float3& Rigid::position() const { return solver->bodies.position[index()]; }
+inline float3& Rigid::initial() const { return solver->bodies.initial[index()]; }
+inline float3& Rigid::inertial() const { return solver->bodies.inertial[index()]; }
+inline float3& Rigid::velocity() const { return solver->bodies.velocity[index()]; }
+inline float3& Rigid::prevVelocity() const { return solver->bodies.prevVelocity[index()]; }
+inline float& Rigid::mass() const { return solver->bodies.mass[index()]; }
+inline float& Rigid::moment() const { return solver->bodies.moment[index()]; }
+inline float2x2& Rigid::rotation() const { return solver->bodies.rotation[index()]; }
+
+inline bool Solver::asleep(const Force* force) const
+{
+    return (force->bodyA && bodies.asleep[force->bodyA->index()]) || (force->bodyB && bodies.asleep[force->bodyB->index()]);
+}
+
+template <typename T, int Rows, int HessianRows>
+TypedForce<T, Rows, HessianRows>::TypedForce(Solver* solver, Rigid* bodyA, Rigid* bodyB)
+    : Force(solver, bodyA, bodyB, ForceTypes::indexOf<T>())
+{
+    solver->forcePool<T>().add(this);
+
+    // Set some reasonable defaults
+    for (int i = 0; i < Rows; i++)
+    {
+        C[i] = 0.0f;
+        stiffness[i] = INFINITY;
+        fmax[i] = INFINITY;
+        fmin[i] = -INFINITY;
+        fracture[i] = INFINITY;
+
+        penalty[i] = 0.0f;
+        lambda[i] = 0.0f;
+    }
+}
+
+template <typename T, int Rows, int HessianRows>
+TypedForce<T, Rows, HessianRows>::~TypedForce()
+{
+    solver->forcePool<T>().remove(this);
+}
+
+template <typename T, int Rows, int HessianRows>
+void TypedForce<T, Rows, HessianRows>::disable()
+{
+    // Disable this force by clearing the relavent fields
+    for (int i = 0; i < Rows; i++)
+    {
+        stiffness[i] = 0;
+        penalty[i] = 0;
+        lambda[i] = 0;
+    }
+}
@@ -12,37 +12,42 @@
 #include "solver.h"
 
 Spring::Spring(Solver* solver, Rigid* bodyA, Rigid* bodyB, float2 rA, float2 rB, float stiffness, float rest)
-    : Force(solver, bodyA, bodyB), rA(rA), rB(rB), rest(rest)
+    : TypedForce(solver, bodyA, bodyB), rA(rA), rB(rB), rest(rest)
 {
     this->stiffness[0] = stiffness;
     if (this->rest < 0)
-        this->rest = length(transform(bodyA->position, rA) - transform(bodyB->position, rB));
+        this->rest = length(transform(bodyA->position(), rA) - transform(bodyB->position(), rB));
 }
 
 void Spring::computeConstraint(float alpha)
 {
     // Compute constraint function at current state C(x)
-    C[0] = length(transform(bodyA->position, rA) - transform(bodyB->position, rB)) - rest;
+    C[0] = length(bodyA->transform(rA) - bodyB->transform(rB)) - rest;
 }
 
-void Spring::computeDerivatives(Rigid* body)
+void Spring::computeDerivatives(Rigid* body, float3* J, float3x3* H)
 {
     // Compute the first and second derivatives for the desired body
     float2x2 S = { 0, -1, 1, 0 };
     float2x2 I = { 1, 0, 0, 1 };
 
-    float2 d = transform(bodyA->position, rA) - transform(bodyB->position, rB);
+    float2 d = bodyA->transform(rA) - bodyB->transform(rB);
     float dlen2 = dot(d, d);
     if (dlen2 == 0)
+    {
+        // The direction is undefined when the attachment points coincide
+        J[0] = { 0, 0, 0 };
+        H[0] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
         return;
+    }
     float dlen = sqrtf(dlen2);
     float2 n = d / dlen;
     float2x2 dxx = (I - outer(n, n) / dlen2) / dlen;
 
     if (body == bodyA)
     {
-        float2 Sr = rotate(bodyA->position.z, S * rA);
-        float2 r = rotate(bodyA->position.z, rA);
+        float2 Sr = bodyA->rotate(S * rA);
+        float2 r = bodyA->rotate(rA);
         float2 dxr = dxx * Sr;
         float drr = dot(Sr, dxr) - dot(n, r);
 
@@ -56,8 +61,8 @@ void Spring::computeDerivatives(Rigid* body)
     }
     else
     {
-        float2 Sr = rotate(bodyB->position.z, S * rB);
-        float2 r = rotate(bodyB->position.z, rB);
+        float2 Sr = bodyB->rotate(S * rB);
+        float2 r = bodyB->rotate(rB);
         float2 dxr = dxx * -Sr;
         float drr = dot(Sr, dxr) + dot(n, r);
 
@@ -70,15 +75,3 @@ void Spring::computeDerivatives(Rigid* body)
         };
     }
 }
-
-void Spring::draw() const
-{
-    float2 v0 = transform(bodyA->position, rA);
-    float2 v1 = transform(bodyB->position, rB);
-
-    glColor3f(0.75f, 0.0f, 0.0f);
-    glBegin(GL_LINES);
-    glVertex2f(v0.x, v0.y);
-    glVertex2f(v1.x, v1.y);
-    glEnd();
-}
@@ -0,0 +1,86 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#pragma once
+
+// Per-step instrumentation of the solver. Define AVBD_STATS to 0 to compile all of the timers and counters out,
+// in which case the StepStats of the solver are left zeroed.
+#ifndef AVBD_STATS
+#define AVBD_STATS 1
+#endif
+
+#if AVBD_STATS
+#include <chrono>
+#endif
+
+// The distinct phases of Solver::step()
+enum StepPhase
+{
+    PHASE_REORDER,      // Periodic spatial reordering of the bodies (see Solver::reorderInterval)
+    PHASE_BROADPHASE,   // Finding overlapping body pairs and creating manifolds
+    PHASE_INITIALIZE,   // Force initialization (including narrowphase collision) and warmstarting
+    PHASE_WARMSTART,    // Computing inertial and warmstarted body positions
+    PHASE_COLORING,     // Graph coloring of the bodies for the parallel primal update
+    PHASE_PRIMAL,       // Primal (body) updates of all iterations
+    PHASE_DUAL,         // Dual (force) updates of all iterations
+    PHASE_VELOCITY,     // BDF1 velocity update
+    PHASE_COUNT
+};
+
+// Timings (in milliseconds) and counters recorded during the last call to Solver::step()
+struct StepStats
+{
+    double time[PHASE_COUNT];
+    double total;
+
+    int pairsTested;        // Body pairs checked by the broadphase
+    int manifoldsCreated;   // New manifolds created by the broadphase
+    int manifoldsDestroyed; // Manifolds removed because they had no contacts
+    int primalRows;         // Constraint rows accumulated into body systems
+    int dualRows;           // Constraint rows updated in the dual step
+    int solves;             // 3x3 LDL solves
+    int awakeBodies;        // Dynamic bodies which weren't asleep
+    int islands;            // Islands of awake dynamic bodies connected by forces
+    int iterations;         // Solver iterations taken (the most of any island)
+    float residual;         // Residual of the last iteration (see Solver::tolerance), the largest of any island
+    float error;            // Largest hard constraint error of the last iteration
+
+    void reset()
+    {
+        *this = StepStats{};
+    }
+};
+
+#if AVBD_STATS
+
+// Adds the elapsed time of the enclosing scope to the given phase
+struct StatsTimer
+{
+    double& time;
+    std::chrono::steady_clock::time_point start;
+
+    StatsTimer(double& time) : time(time), start(std::chrono::steady_clock::now()) {}
+    ~StatsTimer() { time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); }
+};
+
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_TIMER(stats, value) StatsTimer STATS_CONCAT(statsTimer, __LINE__)(stats.value)
+#define STATS_ADD(stats, counter, n) (stats.counter += (n))
+#define STATS_MAX(stats, counter, n) (stats.counter = stats.counter > (n) ? stats.counter : (n))
+
+#else
+
+#define STATS_TIMER(stats, value) ((void)0)
+#define STATS_ADD(stats, counter, n) ((void)sizeof(n))
+#define STATS_MAX(stats, counter, n) ((void)sizeof(n))
+
+#endif
@@ -0,0 +1,229 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#include "threads.h"
+
+#if AVBD_THREADS
+
+#define SPIN_COUNT 4000               // Number of times a worker polls for new work before going to sleep
+
+ThreadPool::ThreadPool()
+    : job(0), taskJob(0), jobCount(0), jobGrain(1), nextChunk(0), busy(0), epoch(0), quit(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    resize(1);
+}
+
+int ThreadPool::size() const
+{
+    return (int)workers.size() + 1;
+}
+
+void ThreadPool::resize(int threads)
+{
+    int count = threads > 1 ? threads - 1 : 0;
+    if (count == (int)workers.size())
+        return;
+
+    // Stop the current workers
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        epoch++;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    quit = false;
+
+    // Start the new ones. They are given the current epoch, so that loops issued before they start running aren't missed.
+    queues.reset(new std::atomic<uint64_t>[count + 1]);
+    for (int i = 0; i < count; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i + 1, epoch.load());
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& fn)
+{
+    if (count <= 0)
+        return;
+
+    // Not worth waking the workers
+    if (workers.empty() || count <= grain)
+    {
+        fn(0, count);
+        return;
+    }
+
+    job = &fn;
+    taskJob = 0;
+    jobCount = count;
+    jobGrain = grain;
+    nextChunk = 0;
+    busy = (int)workers.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        epoch++;
+    }
+    wake.notify_all();
+
+    // Help out, then wait for the workers to finish their last chunks
+    runChunks();
+    while (busy.load() != 0)
+        std::this_thread::yield();
+}
+
+void ThreadPool::parallelTasks(int count, const std::function<void(int)>& fn)
+{
+    if (count <= 0)
+        return;
+
+    if (workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    // Queue q holds the tasks q, q + n, q + 2n, ... as the slots [0, size)
+    int n = size();
+    for (int q = 0; q < n; q++)
+    {
+        uint64_t tail = q < count ? (uint64_t)((count - q + n - 1) / n) : 0;
+        queues[q] = tail << 32;
+    }
+
+    job = 0;
+    taskJob = &fn;
+    jobCount = count;
+    busy = (int)workers.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        epoch++;
+    }
+    wake.notify_all();
+
+    runTasks(0);
+    while (busy.load() != 0)
+        std::this_thread::yield();
+}
+
+bool ThreadPool::popTask(int queue, bool steal, int& task)
+{
+    // The owner takes from the head and thieves from the tail, both by swapping the whole range at once
+    std::atomic<uint64_t>& range = queues[queue];
+    uint64_t current = range.load();
+    while (true)
+    {
+        uint32_t head = (uint32_t)current;
+        uint32_t tail = (uint32_t)(current >> 32);
+        if (head >= tail)
+            return false;
+
+        uint32_t slot = steal ? tail - 1 : head;
+        uint64_t next = steal ? ((uint64_t)(tail - 1) << 32 | head) : ((uint64_t)tail << 32 | (head + 1));
+        if (range.compare_exchange_weak(current, next))
+        {
+            task = (int)slot * size() + queue;
+            return true;
+        }
+    }
+}
+
+void ThreadPool::runTasks(int thread)
+{
+    // Work through the own queue first. No tasks are added while running, so once every other queue
+    // has been found empty there is nothing left to do.
+    int task;
+    while (popTask(thread, false, task))
+        (*taskJob)(task);
+
+    int n = size();
+    for (int i = 1; i < n; i++)
+    {
+        int victim = (thread + i) % n;
+        while (popTask(victim, true, task))
+            (*taskJob)(task);
+    }
+}
+
+void ThreadPool::runChunks()
+{
+    while (true)
+    {
+        int begin = nextChunk.fetch_add(1) * jobGrain;
+        if (begin >= jobCount)
+            break;
+        (*job)(begin, begin + jobGrain < jobCount ? begin + jobGrain : jobCount);
+    }
+}
+
+void ThreadPool::workerLoop(int thread, unsigned seen)
+{
+    while (true)
+    {
+        // Spin for a while, since the next loop is usually only microseconds away
+        for (int i = 0; i < SPIN_COUNT && epoch.load() == seen; i++)
+            std::this_thread::yield();
+
+        if (epoch.load() == seen)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return epoch.load() != seen; });
+        }
+
+        seen = epoch.load();
+        if (quit)
+            return;
+
+        if (taskJob)
+            runTasks(thread);
+        else
+            runChunks();
+        busy--;
+    }
+}
+
+#else
+
+ThreadPool::ThreadPool()
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+}
+
+int ThreadPool::size() const
+{
+    return 1;
+}
+
+void ThreadPool::resize(int threads)
+{
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& fn)
+{
+    if (count > 0)
+        fn(0, count);
+}
+
+void ThreadPool::parallelTasks(int count, const std::function<void(int)>& fn)
+{
+    for (int i = 0; i < count; i++)
+        fn(i);
+}
+
+#endif
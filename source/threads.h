@@ -0,0 +1,73 @@
+/*
+* Copyright (c) 2025 Chris Giles
+*
+* Permission to use, copy, modify, distribute and sell this software
+* and its documentation for any purpose is hereby granted without fee,
+* provided that the above copyright notice appear in all copies.
+* Chris Giles makes no representations about the suitability
+* of this software for any purpose.
+* It is provided "as is" without express or implied warranty.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include <memory>
+
+// Web builds without pthread support run everything on the calling thread
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define AVBD_THREADS 0
+#else
+#define AVBD_THREADS 1
+#endif
+
+#if AVBD_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#endif
+
+// Simple persistent thread pool for data parallel loops. The calling thread takes part in every loop,
+// and workers spin briefly before sleeping, since the solver issues many short loops per step.
+struct ThreadPool
+{
+    ThreadPool();
+    ~ThreadPool();
+
+    // Total number of threads used by parallelFor, including the calling thread
+    int size() const;
+    void resize(int threads);
+
+    // Calls fn(begin, end) over [0, count) in chunks of at most grain items, and returns once all chunks are done
+    void parallelFor(int count, int grain, const std::function<void(int, int)>& fn);
+
+    // Calls fn(task) for each task in [0, count), and returns once all tasks are done. Tasks are dealt round robin
+    // to a queue per thread, and threads which run out steal from the back of the others, so tasks of very different
+    // costs are balanced. Ordering the tasks from the most to the least expensive works best.
+    void parallelTasks(int count, const std::function<void(int)>& fn);
+
+private:
+#if AVBD_THREADS
+    void workerLoop(int thread, unsigned seen);
+    void runChunks();
+    void runTasks(int thread);
+    bool popTask(int queue, bool steal, int& task);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    const std::function<void(int, int)>* job;
+    const std::function<void(int)>* taskJob;
+    int jobCount;
+    int jobGrain;
+    std::atomic<int> nextChunk;
+    std::unique_ptr<std::atomic<uint64_t>[]> queues;  // Remaining tasks of each thread, with the head in the low 32 bits and the tail in the high
+    std::atomic<int> busy;
+    std::atomic<unsigned> epoch;
+    bool quit;
+#endif
+};